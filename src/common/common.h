@@ -18,4 +18,8 @@ typedef          char       int8;
 
 typedef uint8 bool;
 
+// Get the struct which embeds member at address ptr.
+#define container_of(ptr, type, member) \
+    ((type*)((uint32)(ptr) - (uint32)(&((type*)0)->member)))
+
 #endif
@@ -0,0 +1,15 @@
+#ifndef COMMON_ERRNO_H
+#define COMMON_ERRNO_H
+
+// Error numbers. Syscalls return them negated, e.g. -ENOSYS.
+#define EPERM     1   // operation not permitted
+#define ENOENT    2   // no such file or directory
+#define EIO       5   // disk I/O error
+#define EBADF     9   // bad file descriptor
+#define ENOMEM   12   // out of memory
+#define EFAULT   14   // bad address
+#define EINVAL   22   // invalid argument
+#define EMFILE   24   // too many open files
+#define ENOSYS   38   // syscall not implemented
+
+#endif
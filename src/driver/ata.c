@@ -0,0 +1,659 @@
+#include "common/io.h"
+#include "common/stdlib.h"
+#include "driver/ata.h"
+#include "driver/pci.h"
+#include "interrupt/interrupt.h"
+#include "mem/dma.h"
+#include "mem/paging.h"
+#include "monitor/monitor.h"
+#include "sync/mutex.h"
+#include "sync/spinlock.h"
+#include "sync/wait_queue.h"
+#include "task/scheduler.h"
+#include "utils/math.h"
+
+// command block registers, offsets from channel io_base
+#define ATA_REG_DATA          0
+#define ATA_REG_ERROR         1
+#define ATA_REG_SECTOR_COUNT  2
+#define ATA_REG_LBA_LOW       3
+#define ATA_REG_LBA_MID       4
+#define ATA_REG_LBA_HIGH      5
+#define ATA_REG_DEVICE        6
+#define ATA_REG_STATUS        7
+#define ATA_REG_COMMAND       7
+// control block registers, offsets from channel control_base
+#define ATA_REG_CONTROL       0
+#define ATA_REG_ALT_STATUS    0
+
+#define ATA_STATUS_ERR   0x01
+#define ATA_STATUS_DRQ   0x08
+#define ATA_STATUS_DF    0x20
+#define ATA_STATUS_BSY   0x80
+
+#define ATA_CONTROL_NIEN  0x02
+
+#define ATA_CMD_READ_SECTORS    0x20
+#define ATA_CMD_READ_SECTORS_EXT  0x24
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_READ_MULTIPLE_EXT  0x29
+#define ATA_CMD_WRITE_SECTORS   0x30
+#define ATA_CMD_WRITE_SECTORS_EXT  0x34
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT  0x39
+#define ATA_CMD_READ_MULTIPLE   0xC4
+#define ATA_CMD_WRITE_MULTIPLE  0xC5
+#define ATA_CMD_SET_MULTIPLE    0xC6
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_FLUSH_CACHE     0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT 0xEA
+#define ATA_CMD_IDENTIFY        0xEC
+
+// Bus master IDE registers, offsets from BAR4 + channel * BM_CHANNEL_STRIDE.
+#define BM_CHANNEL_STRIDE  0x08
+#define BM_REG_COMMAND   0x00
+#define BM_REG_STATUS    0x02
+#define BM_REG_PRDT      0x04
+
+#define BM_COMMAND_START      0x01
+// set if device writes to memory, i.e. a disk read
+#define BM_COMMAND_READ       0x08
+#define BM_STATUS_ACTIVE      0x01
+#define BM_STATUS_ERR         0x02
+#define BM_STATUS_IRQ         0x04
+
+// Physical region descriptor. A region must not cross a 64KB boundary, and byte_count 0
+// means 64KB.
+struct ata_prd {
+  uint32 phy_addr;
+  uint16 byte_count;
+  uint16 flags;
+} __attribute__((packed));
+typedef struct ata_prd ata_prd_t;
+
+#define ATA_PRD_EOT      0x8000
+#define ATA_PRD_REGION   0x10000
+#define ATA_PRDT_MAX     (PAGE_SIZE / sizeof(ata_prd_t))
+
+// An in-flight command, and where the next PIO data block goes. Segment buffers may be in
+// the issuer's user space, so only the issuer touches them.
+struct ata_request {
+  uint32 lba;
+  block_segment_t* segments;
+  uint32 segments_num;
+  bool write;
+  bool dma;
+  bool flush;
+  // issued with 48-bit LBA EXT command
+  bool lba48;
+  uint32 segment_index;
+  uint32 segment_sector;
+  uint32 sectors_left;
+  // a PIO data block is ready, for the issuer to move
+  volatile bool data_ready;
+  volatile bool done;
+  int32 result;
+  uint8 error;
+};
+typedef struct ata_request ata_request_t;
+
+// An IDE channel and the master disk on it. Channels have their own ports and IRQ, so they
+// run commands independently of each other.
+struct ata_channel {
+  char* name;
+  uint16 io_base;
+  uint16 control_base;
+  uint32 irq;
+  ata_device_t device;
+
+  // The device runs one command at a time. Callers queue on device_lock, and the owner
+  // sleeps on request_wait until IRQ handler completes crt_request.
+  mutex_t device_lock;
+  ata_request_t* volatile crt_request;
+  wait_queue_t request_wait;
+  // Masks channel IRQ while the issuer moves a PIO data block.
+  spinlock_t request_lock;
+
+  // bus master DMA, only used with IRQ
+  bool dma_available;
+  uint16 bm_base;
+  ata_prd_t* prdt;
+  uint32 prdt_phy;
+
+  block_device_t block_device;
+};
+typedef struct ata_channel ata_channel_t;
+
+static ata_channel_t channels[ATA_CHANNELS_NUM] = {
+  { .name = "ata0", .io_base = 0x1F0, .control_base = 0x3F6, .irq = IRQ14_INT_NUM },
+  { .name = "ata1", .io_base = 0x170, .control_base = 0x376, .irq = IRQ15_INT_NUM },
+};
+
+static uint8 ata_inb(ata_channel_t* channel, uint16 reg) {
+  return inb(channel->io_base + reg);
+}
+
+static void ata_outb(ata_channel_t* channel, uint16 reg, uint8 value) {
+  outb(channel->io_base + reg, value);
+}
+
+// Reading alternate status takes ~100ns, and status is only valid 400ns after a command or
+// drive select.
+static void ata_delay_400ns(ata_channel_t* channel) {
+  for (uint32 i = 0; i < 4; i++) {
+    inb(channel->control_base + ATA_REG_ALT_STATUS);
+  }
+}
+
+static uint8 ata_wait_not_busy(ata_channel_t* channel) {
+  uint8 status;
+  while ((status = ata_inb(channel, ATA_REG_STATUS)) & ATA_STATUS_BSY) {}
+  return status;
+}
+
+// Wait for the next DRQ data block. Returns false on device error.
+static bool ata_wait_drq(ata_channel_t* channel) {
+  while (true) {
+    uint8 status = ata_wait_not_busy(channel);
+    if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+      return false;
+    }
+    if (status & ATA_STATUS_DRQ) {
+      return true;
+    }
+  }
+}
+
+// IDENTIFY strings are big-endian words.
+static void ata_copy_string(char* dst, uint16* words, uint32 words_num) {
+  for (uint32 i = 0; i < words_num; i++) {
+    dst[i * 2] = (char)(words[i] >> 8);
+    dst[i * 2 + 1] = (char)(words[i] & 0xFF);
+  }
+  dst[words_num * 2] = '\0';
+  for (int32 i = words_num * 2 - 1; i >= 0 && dst[i] == ' '; i--) {
+    dst[i] = '\0';
+  }
+}
+
+static bool ata_identify(ata_channel_t* channel) {
+  ata_device_t* device = &channel->device;
+  ata_outb(channel, ATA_REG_DEVICE, 0xA0);
+  ata_delay_400ns(channel);
+  if (ata_inb(channel, ATA_REG_STATUS) == 0xFF) {
+    // floating bus, no controller on this channel
+    return false;
+  }
+  ata_outb(channel, ATA_REG_SECTOR_COUNT, 0);
+  ata_outb(channel, ATA_REG_LBA_LOW, 0);
+  ata_outb(channel, ATA_REG_LBA_MID, 0);
+  ata_outb(channel, ATA_REG_LBA_HIGH, 0);
+  ata_outb(channel, ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+  ata_delay_400ns(channel);
+  if (ata_inb(channel, ATA_REG_STATUS) == 0) {
+    // no device
+    return false;
+  }
+  ata_wait_not_busy(channel);
+  if (ata_inb(channel, ATA_REG_LBA_MID) != 0 || ata_inb(channel, ATA_REG_LBA_HIGH) != 0) {
+    // not ATA, e.g. ATAPI
+    return false;
+  }
+  if (!ata_wait_drq(channel)) {
+    return false;
+  }
+
+  uint16 identify[256];
+  insw(channel->io_base + ATA_REG_DATA, identify, 256);
+  device->sectors = identify[60] | ((uint32)identify[61] << 16);
+  // command set supported word 83 bit 10, and LBA48 sector count in words 100-103
+  device->lba48 = (identify[83] & (1 << 10)) != 0;
+  if (device->lba48) {
+    if (identify[102] != 0 || identify[103] != 0) {
+      device->sectors = 0xFFFFFFFF;
+    } else {
+      device->sectors = max(device->sectors, identify[100] | ((uint32)identify[101] << 16));
+    }
+  }
+  device->multiple = identify[47] & 0xFF;
+  // multiword DMA supported
+  device->dma = (identify[49] & (1 << 8)) != 0;
+  ata_copy_string(device->model, identify + 27, 20);
+  return true;
+}
+
+// Enable READ MULTIPLE, so that device raises DRQ once per block of sectors.
+static void ata_set_multiple(ata_channel_t* channel) {
+  ata_device_t* device = &channel->device;
+  uint32 multiple = min(device->multiple, ATA_MULTIPLE_MAX);
+  device->multiple = 1;
+  if (multiple <= 1) {
+    return;
+  }
+  ata_outb(channel, ATA_REG_DEVICE, 0xE0);
+  ata_outb(channel, ATA_REG_SECTOR_COUNT, multiple);
+  ata_outb(channel, ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+  ata_delay_400ns(channel);
+  if (ata_wait_not_busy(channel) & ATA_STATUS_ERR) {
+    return;
+  }
+  device->multiple = multiple;
+}
+
+// Move one PIO data block of the request, which has device->multiple sectors except maybe
+// the last one.
+static void ata_transfer_block(ata_channel_t* channel, ata_request_t* request) {
+  uint32 block = min(request->sectors_left, channel->device.multiple);
+  for (uint32 i = 0; i < block; i++) {
+    block_segment_t* segment = &request->segments[request->segment_index];
+    char* buffer = segment->buffer + request->segment_sector * ATA_SECTOR_SIZE;
+    if (request->write) {
+      outsw(channel->io_base + ATA_REG_DATA, buffer, ATA_SECTOR_SIZE / 2);
+    } else {
+      insw(channel->io_base + ATA_REG_DATA, buffer, ATA_SECTOR_SIZE / 2);
+    }
+    request->segment_sector++;
+    if (request->segment_sector == segment->sectors) {
+      request->segment_index++;
+      request->segment_sector = 0;
+    }
+  }
+  request->sectors_left -= block;
+}
+
+static void ata_complete_request(ata_channel_t* channel, ata_request_t* request, int32 result) {
+  channel->crt_request = nullptr;
+  request->result = result;
+  request->done = true;
+  wake_up_all(&channel->request_wait);
+}
+
+static void ata_dma_interrupt(ata_channel_t* channel, ata_request_t* request) {
+  uint8 bm_status = inb(channel->bm_base + BM_REG_STATUS);
+  if (!(bm_status & BM_STATUS_IRQ)) {
+    return;
+  }
+  outb(channel->bm_base + BM_REG_COMMAND, 0);
+  uint8 status = ata_inb(channel, ATA_REG_STATUS);
+  outb(channel->bm_base + BM_REG_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR);
+  if ((bm_status & BM_STATUS_ERR) || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+    request->error = ata_inb(channel, ATA_REG_ERROR);
+    ata_complete_request(channel, request, -1);
+    return;
+  }
+  request->sectors_left = 0;
+  ata_complete_request(channel, request, 0);
+}
+
+// Device raises channel IRQ when a PIO read block is ready, a PIO write block is consumed,
+// a DMA command finishes, or the command fails. The handler runs in whatever process is
+// current, so for PIO it only wakes the issuer up to move the block.
+static void ata_channel_interrupt(ata_channel_t* channel) {
+  ata_request_t* request = channel->crt_request;
+  if (request == nullptr) {
+    // Reading status acknowledges the interrupt.
+    ata_inb(channel, ATA_REG_STATUS);
+    return;
+  }
+  if (request->dma) {
+    ata_dma_interrupt(channel, request);
+    return;
+  }
+
+  uint8 status = ata_inb(channel, ATA_REG_STATUS);
+  if (request->flush) {
+    if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+      request->error = ata_inb(channel, ATA_REG_ERROR);
+    }
+    ata_complete_request(channel, request, request->error != 0 ? -1 : 0);
+    return;
+  }
+  if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+    request->error = ata_inb(channel, ATA_REG_ERROR);
+    ata_complete_request(channel, request, -1);
+    return;
+  }
+  if (request->write && request->sectors_left == 0) {
+    // last written block is committed
+    ata_complete_request(channel, request, 0);
+    return;
+  }
+  if (status & ATA_STATUS_DRQ) {
+    request->data_ready = true;
+    wake_up_all(&channel->request_wait);
+  }
+}
+
+static void ata_primary_interrupt_handler(isr_params_t params) {
+  ata_channel_interrupt(&channels[ATA_PRIMARY]);
+}
+
+static void ata_secondary_interrupt_handler(isr_params_t params) {
+  ata_channel_interrupt(&channels[ATA_SECONDARY]);
+}
+
+static void ata_init_dma(ata_channel_t* channel, uint32 index) {
+  if (!channel->device.dma) {
+    return;
+  }
+  pci_device_t ide;
+  if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide)) {
+    channel->device.dma = false;
+    return;
+  }
+  uint32 bar4 = pci_config_read(&ide, PCI_CONFIG_BAR4);
+  if (!(bar4 & PCI_BAR_IO) || (bar4 & PCI_BAR_IO_MASK) == 0) {
+    channel->device.dma = false;
+    return;
+  }
+  channel->bm_base = (bar4 & PCI_BAR_IO_MASK) + index * BM_CHANNEL_STRIDE;
+  pci_enable_bus_master(&ide);
+
+  // One page holds the whole table, so it never crosses a 64KB boundary.
+  channel->prdt = (ata_prd_t*)dma_alloc_pages(1, &channel->prdt_phy);
+  if (channel->prdt == nullptr) {
+    channel->device.dma = false;
+    return;
+  }
+  channel->dma_available = true;
+}
+
+static ata_channel_t* device_channel(block_device_t* dev) {
+  return container_of(dev, ata_channel_t, block_device);
+}
+
+static int32 ata_block_read(
+    block_device_t* dev, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return ata_read(device_channel(dev) - channels, lba, segments, segments_num);
+}
+
+static int32 ata_block_write(
+    block_device_t* dev, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return ata_write(device_channel(dev) - channels, lba, segments, segments_num);
+}
+
+static int32 ata_block_flush(block_device_t* dev) {
+  return ata_flush(device_channel(dev) - channels);
+}
+
+block_device_t* init_ata(uint32 index) {
+  ata_channel_t* channel = &channels[index];
+  memset(&channel->device, 0, sizeof(ata_device_t));
+  mutex_init(&channel->device_lock);
+  channel->crt_request = nullptr;
+  wait_queue_init(&channel->request_wait);
+  spinlock_init(&channel->request_lock);
+  channel->dma_available = false;
+  register_interrupt_handler(channel->irq, index == ATA_PRIMARY ?
+      &ata_primary_interrupt_handler : &ata_secondary_interrupt_handler);
+  // Poll until multitasking starts, disable device interrupt.
+  outb(channel->control_base + ATA_REG_CONTROL, ATA_CONTROL_NIEN);
+
+  if (!ata_identify(channel)) {
+    monitor_printf("ata: %s master not found\n", index == ATA_PRIMARY ? "primary" : "secondary");
+    return nullptr;
+  }
+  ata_set_multiple(channel);
+  ata_init_dma(channel, index);
+  channel->device.present = true;
+
+  block_device_t* dev = &channel->block_device;
+  memset(dev, 0, sizeof(block_device_t));
+  dev->name = channel->name;
+  dev->sectors = channel->device.sectors;
+  dev->max_sectors = channel->device.lba48 ? ATA_LBA48_SECTORS_MAX : ATA_READ_SECTORS_MAX;
+  dev->read = ata_block_read;
+  dev->write = ata_block_write;
+  dev->flush = ata_block_flush;
+  return dev;
+}
+
+ata_device_t* ata_get_device(uint32 index) {
+  return &channels[index].device;
+}
+
+bool ata_set_dma(bool enabled) {
+  bool dma = false;
+  for (uint32 i = 0; i < ATA_CHANNELS_NUM; i++) {
+    ata_channel_t* channel = &channels[i];
+    channel->device.dma = enabled && channel->dma_available;
+    dma = dma || channel->device.dma;
+  }
+  return dma;
+}
+
+// Build PRD table for the request segments. Physically contiguous pages are merged into one
+// region. Returns false if the buffers can not be described, then PIO is used instead.
+static bool ata_build_prdt(ata_channel_t* channel, ata_request_t* request) {
+  ata_prd_t* prdt = channel->prdt;
+  uint32 num = 0;
+  for (uint32 i = 0; i < request->segments_num; i++) {
+    char* addr = request->segments[i].buffer;
+    uint32 left = request->segments[i].sectors * ATA_SECTOR_SIZE;
+    while (left > 0) {
+      uint32 length = min(left, PAGE_SIZE - (uint32)addr % PAGE_SIZE);
+      int32 phy = dma_buffer_phy(addr, !request->write);
+      if (phy < 0 || (phy & 0x1) != 0) {
+        return false;
+      }
+
+      ata_prd_t* last = num > 0 ? &prdt[num - 1] : nullptr;
+      uint32 last_count = last == nullptr ? 0 :
+          (last->byte_count == 0 ? ATA_PRD_REGION : last->byte_count);
+      if (last != nullptr && last->phy_addr + last_count == (uint32)phy &&
+          last->phy_addr / ATA_PRD_REGION == (uint32)phy / ATA_PRD_REGION &&
+          last_count + length <= ATA_PRD_REGION) {
+        last->byte_count = (uint16)(last_count + length);
+      } else {
+        if (num == ATA_PRDT_MAX) {
+          return false;
+        }
+        prdt[num].phy_addr = phy;
+        prdt[num].byte_count = (uint16)length;
+        prdt[num].flags = 0;
+        num++;
+      }
+      addr += length;
+      left -= length;
+    }
+  }
+  prdt[num - 1].flags = ATA_PRD_EOT;
+  return true;
+}
+
+static bool request_has_work(void* arg) {
+  ata_request_t* request = (ata_request_t*)arg;
+  return request->done || request->data_ready;
+}
+
+static uint8 ata_command_ext(ata_channel_t* channel, ata_request_t* request) {
+  if (request->dma) {
+    return request->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+  }
+  if (channel->device.multiple > 1) {
+    return request->write ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE_EXT;
+  }
+  return request->write ? ATA_CMD_WRITE_SECTORS_EXT : ATA_CMD_READ_SECTORS_EXT;
+}
+
+static uint8 ata_command(ata_channel_t* channel, ata_request_t* request) {
+  if (request->flush) {
+    return channel->device.lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE;
+  }
+  if (request->lba48) {
+    return ata_command_ext(channel, request);
+  }
+  if (request->dma) {
+    return request->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+  }
+  if (channel->device.multiple > 1) {
+    return request->write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+  }
+  return request->write ? ATA_CMD_WRITE_SECTORS : ATA_CMD_READ_SECTORS;
+}
+
+static void ata_issue(ata_channel_t* channel, ata_request_t* request, bool use_irq) {
+  ata_wait_not_busy(channel);
+  outb(channel->control_base + ATA_REG_CONTROL, use_irq ? 0 : ATA_CONTROL_NIEN);
+  uint16 bm_base = channel->bm_base;
+  if (request->dma) {
+    outl(bm_base + BM_REG_PRDT, channel->prdt_phy);
+    outb(bm_base + BM_REG_COMMAND, request->write ? 0 : BM_COMMAND_READ);
+    outb(bm_base + BM_REG_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR);
+  }
+  if (request->lba48) {
+    // High order bytes go first, and each register keeps the last two bytes written. Sector
+    // count 0 means 65536, and lba bits 32-47 are always 0.
+    ata_outb(channel, ATA_REG_DEVICE, 0x40);
+    ata_outb(channel, ATA_REG_SECTOR_COUNT, (uint8)(request->sectors_left >> 8));
+    ata_outb(channel, ATA_REG_LBA_LOW, (uint8)(request->lba >> 24));
+    ata_outb(channel, ATA_REG_LBA_MID, 0);
+    ata_outb(channel, ATA_REG_LBA_HIGH, 0);
+  } else {
+    ata_outb(channel, ATA_REG_DEVICE, 0xE0 | ((request->lba >> 24) & 0x0F));
+  }
+  ata_outb(channel, ATA_REG_SECTOR_COUNT, (uint8)request->sectors_left);
+  ata_outb(channel, ATA_REG_LBA_LOW, (uint8)request->lba);
+  ata_outb(channel, ATA_REG_LBA_MID, (uint8)(request->lba >> 8));
+  ata_outb(channel, ATA_REG_LBA_HIGH, (uint8)(request->lba >> 16));
+  ata_outb(channel, ATA_REG_COMMAND, ata_command(channel, request));
+  if (request->dma) {
+    outb(bm_base + BM_REG_COMMAND, (request->write ? 0 : BM_COMMAND_READ) | BM_COMMAND_START);
+  }
+  ata_delay_400ns(channel);
+}
+
+// Before multitasking starts there is no other thread to run, so just poll the device.
+static void ata_poll_request(ata_channel_t* channel, ata_request_t* request) {
+  if (request->flush) {
+    if (ata_wait_not_busy(channel) & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+      request->error = ata_inb(channel, ATA_REG_ERROR);
+      request->result = -1;
+      return;
+    }
+    request->result = 0;
+    return;
+  }
+  while (request->sectors_left > 0) {
+    if (!ata_wait_drq(channel)) {
+      request->error = ata_inb(channel, ATA_REG_ERROR);
+      request->result = -1;
+      return;
+    }
+    ata_transfer_block(channel, request);
+  }
+  if (request->write && (ata_wait_not_busy(channel) & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+    request->error = ata_inb(channel, ATA_REG_ERROR);
+    request->result = -1;
+    return;
+  }
+  request->result = 0;
+}
+
+// Move the PIO data block IRQ handler found ready. Channel IRQ is masked meanwhile, so that
+// the IRQ for the next block sees the request updated.
+static void ata_move_ready_block(ata_channel_t* channel, ata_request_t* request) {
+  spinlock_lock_irqsave(&channel->request_lock);
+  if (!request->done) {
+    request->data_ready = false;
+    ata_transfer_block(channel, request);
+    if (!request->write && request->sectors_left == 0) {
+      ata_complete_request(channel, request, 0);
+    }
+  }
+  spinlock_unlock_irqrestore(&channel->request_lock);
+}
+
+static void ata_irq_request(ata_channel_t* channel, ata_request_t* request) {
+  // Publish the request before issuing the command, IRQ may come right after it.
+  spinlock_lock_irqsave(&channel->request_lock);
+  channel->crt_request = request;
+  ata_issue(channel, request, true);
+  if (request->write && !request->dma) {
+    // PIO write has no IRQ for the first block, device only asks for it by DRQ.
+    if (ata_wait_drq(channel)) {
+      request->data_ready = true;
+    } else {
+      request->error = ata_inb(channel, ATA_REG_ERROR);
+      ata_complete_request(channel, request, -1);
+    }
+  }
+  spinlock_unlock_irqrestore(&channel->request_lock);
+
+  while (true) {
+    wait_event(&channel->request_wait, request_has_work, request);
+    if (request->done) {
+      break;
+    }
+    ata_move_ready_block(channel, request);
+  }
+}
+
+// Run the request on channel, by IRQ if possible, otherwise by polling.
+static void ata_run_request(ata_channel_t* channel, ata_request_t* request) {
+  bool use_irq = multi_task_is_enabled() && !is_in_irq_context();
+  mutex_lock(&channel->device_lock);
+  if (use_irq) {
+    request->dma = request->dma && channel->device.dma && ata_build_prdt(channel, request);
+    ata_irq_request(channel, request);
+  } else {
+    request->dma = false;
+    ata_issue(channel, request, false);
+    ata_poll_request(channel, request);
+  }
+  mutex_unlock(&channel->device_lock);
+}
+
+static int32 ata_transfer(
+    uint32 index, uint32 lba, block_segment_t* segments, uint32 segments_num, bool write) {
+  ata_channel_t* channel = &channels[index];
+  uint32 count = 0;
+  for (uint32 i = 0; i < segments_num; i++) {
+    count += segments[i].sectors;
+  }
+  // Use LBA48 only when needed, LBA28 commands take fewer register writes.
+  bool lba48 = count > ATA_READ_SECTORS_MAX || lba >= ATA_LBA28_SECTORS ||
+               ATA_LBA28_SECTORS - lba < count;
+  if (count == 0 || (lba48 && (!channel->device.lba48 || count > ATA_LBA48_SECTORS_MAX))) {
+    return -1;
+  }
+
+  ata_request_t request;
+  memset(&request, 0, sizeof(ata_request_t));
+  request.lba = lba;
+  request.segments = segments;
+  request.segments_num = segments_num;
+  request.write = write;
+  request.lba48 = lba48;
+  request.dma = true;
+  request.sectors_left = count;
+  ata_run_request(channel, &request);
+
+  if (request.result != 0) {
+    monitor_printf("%s: %s error %x on lba %u\n", channel->name, write ? "write" : "read",
+                   request.error, lba + count - request.sectors_left);
+  }
+  return request.result;
+}
+
+int32 ata_read(uint32 index, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return ata_transfer(index, lba, segments, segments_num, false);
+}
+
+int32 ata_write(uint32 index, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return ata_transfer(index, lba, segments, segments_num, true);
+}
+
+int32 ata_flush(uint32 index) {
+  ata_channel_t* channel = &channels[index];
+  ata_request_t request;
+  memset(&request, 0, sizeof(ata_request_t));
+  request.flush = true;
+  ata_run_request(channel, &request);
+
+  if (request.result != 0) {
+    monitor_printf("%s: flush cache error %x\n", channel->name, request.error);
+  }
+  return request.result;
+}
@@ -0,0 +1,69 @@
+#ifndef DRIVER_ATA_H
+#define DRIVER_ATA_H
+
+#include "common/common.h"
+#include "driver/block_device.h"
+
+// ATA driver for the master disks of the primary and secondary IDE channels. Each channel
+// runs one command at a time, independently of the other. Once multitasking starts, a caller
+// issues its command and sleeps, and the channel IRQ handler completes it and wakes the
+// caller up. Bus master DMA is used if the PCI IDE controller supports it. Otherwise the IRQ
+// handler wakes the caller up for each PIO data block, and the caller moves it, since the
+// buffer may be in the caller's user space. Before multitasking, the device is polled with PIO.
+//
+// Commands use 28-bit LBA by default. If IDENTIFY reports 48-bit LBA support, the EXT
+// commands are used for requests which reach beyond LBA28 or are longer than 256 sectors.
+
+#define ATA_CHANNELS_NUM       2
+#define ATA_PRIMARY            0
+#define ATA_SECONDARY          1
+
+#define ATA_SECTOR_SIZE        512
+// max sectors of one LBA28 read command (sector count 0 means 256)
+#define ATA_READ_SECTORS_MAX   256
+// max sectors of one LBA48 command we issue, 1MB. The one page PRD table describes it even
+// if no two pages of the buffer are physically contiguous.
+#define ATA_LBA48_SECTORS_MAX  2048
+// sectors addressable by LBA28
+#define ATA_LBA28_SECTORS      (1 << 28)
+// max sectors per READ MULTIPLE block we ask the device for
+#define ATA_MULTIPLE_MAX       16
+
+struct ata_device {
+  bool present;
+  // total addressable sectors, capped to 32-bit lba of block layer
+  uint32 sectors;
+  // 48-bit LBA commands supported
+  bool lba48;
+  // sectors per DRQ block, > 1 if READ MULTIPLE is enabled
+  uint32 multiple;
+  // bus master DMA in use
+  bool dma;
+  char model[41];
+};
+typedef struct ata_device ata_device_t;
+
+
+// ****************************************************************************
+// Probe the master disk of channel ATA_PRIMARY or ATA_SECONDARY. Returns its block device,
+// "ata0" or "ata1", or nullptr if not present.
+block_device_t* init_ata(uint32 channel);
+
+ata_device_t* ata_get_device(uint32 channel);
+
+// Turn DMA on or off on all channels, e.g. for benchmarking PIO. Returns whether DMA is in
+// use on any channel.
+bool ata_set_dma(bool enabled);
+
+// Read consecutive sectors from lba by one command, scattered into segments. Total sectors
+// must not exceed ATA_READ_SECTORS_MAX, or ATA_LBA48_SECTORS_MAX on LBA48 disks. Returns 0 on
+// success, -1 on device error. Concurrent callers of the same channel are serialized.
+int32 ata_read(uint32 channel, uint32 lba, block_segment_t* segments, uint32 segments_num);
+
+// Write consecutive sectors from lba by one command, gathered from segments.
+int32 ata_write(uint32 channel, uint32 lba, block_segment_t* segments, uint32 segments_num);
+
+// Flush drive write cache to media.
+int32 ata_flush(uint32 channel);
+
+#endif
@@ -0,0 +1,26 @@
+#include "driver/block_device.h"
+
+int32 block_device_transfer(block_device_t* dev, block_request_t** requests, uint32 num) {
+  int32 ret = 0;
+  if (dev->submit != nullptr) {
+    dev->submit(dev, requests, num);
+    for (uint32 i = 0; i < num; i++) {
+      dev->wait(dev, requests[i]);
+      if (requests[i]->result != 0) {
+        ret = -1;
+      }
+    }
+    return ret;
+  }
+
+  for (uint32 i = 0; i < num; i++) {
+    block_request_t* request = requests[i];
+    block_transfer_func transfer = request->write ? dev->write : dev->read;
+    request->result = transfer(dev, request->lba, request->segments, request->segments_num);
+    request->done = true;
+    if (request->result != 0) {
+      ret = -1;
+    }
+  }
+  return ret;
+}
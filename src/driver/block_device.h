@@ -0,0 +1,72 @@
+#ifndef DRIVER_BLOCK_DEVICE_H
+#define DRIVER_BLOCK_DEVICE_H
+
+#include "common/common.h"
+
+// Common interface of disk drivers. hard_disk reads through the block device found at boot,
+// so file systems work the same on any backend.
+
+#define BLOCK_SECTOR_SIZE  512
+
+// A part of a transfer: the next sectors are transferred to / from buffer.
+struct block_segment {
+  char* buffer;
+  uint32 sectors;
+};
+typedef struct block_segment block_segment_t;
+
+// An asynchronous request. Device sets result and then done on completion.
+struct block_request {
+  uint32 lba;
+  block_segment_t* segments;
+  uint32 segments_num;
+  bool write;
+  // flush device write cache, with no data
+  bool flush;
+  volatile bool done;
+  int32 result;
+};
+typedef struct block_request block_request_t;
+
+struct block_device;
+
+// Transfer consecutive sectors from lba by one device request, scattered into / gathered
+// from segments. Total sectors must not exceed max_sectors. Returns 0 on success, -1 on
+// device error. Blocks until completion, concurrent callers are allowed.
+typedef int32 (*block_transfer_func)(
+    struct block_device* dev, uint32 lba, block_segment_t* segments, uint32 segments_num);
+
+// Flush device volatile write cache, so that completed writes are durable.
+typedef int32 (*block_flush_func)(struct block_device* dev);
+
+// Queue requests to device, and kick it once for all of them.
+typedef void (*block_submit_func)(
+    struct block_device* dev, block_request_t** requests, uint32 num);
+// Block until a submitted request is done.
+typedef void (*block_wait_func)(struct block_device* dev, block_request_t* request);
+
+struct block_device {
+  char* name;
+  // capacity in sectors
+  uint32 sectors;
+  // max sectors of one request
+  uint32 max_sectors;
+
+  // functions
+  block_transfer_func read;
+  block_transfer_func write;
+  // optional, for devices with volatile write cache
+  block_flush_func flush;
+  // optional, for devices which keep multiple requests in flight
+  block_submit_func submit;
+  block_wait_func wait;
+};
+typedef struct block_device block_device_t;
+
+
+// ****************************************************************************
+// Run requests on device: together if it supports submit, or one after another. Returns -1
+// if any of them fails.
+int32 block_device_transfer(block_device_t* dev, block_request_t** requests, uint32 num);
+
+#endif
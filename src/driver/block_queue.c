@@ -0,0 +1,317 @@
+#include "common/stdlib.h"
+#include "driver/block_queue.h"
+#include "mem/kheap.h"
+#include "monitor/monitor.h"
+#include "task/scheduler.h"
+
+void block_queue_init(block_queue_t* queue, block_device_t* dev) {
+  queue->dev = dev;
+  linked_list_init(&queue->requests);
+  linked_list_init(&queue->in_flight);
+  queue->head_lba = 0;
+  queue->sweep_up = true;
+  yieldlock_init(&queue->lock);
+  wait_queue_init(&queue->dispatch_wait);
+  wait_queue_init(&queue->complete_wait);
+  queue->dispatcher_started = false;
+  queue->completions = 0;
+  memset(&queue->stats, 0, sizeof(block_queue_stats_t));
+}
+
+static block_queue_request_t* node_request(linked_list_node_t* node) {
+  return (block_queue_request_t*)node->ptr;
+}
+
+static bio_t* node_bio(linked_list_node_t* node) {
+  return (bio_t*)node->ptr;
+}
+
+static bool overlaps(uint32 lba1, uint32 sectors1, uint32 lba2, uint32 sectors2) {
+  return lba1 < lba2 + sectors2 && lba2 < lba1 + sectors1;
+}
+
+// Whether a write is involved in an overlap with bio, in list of requests.
+static bool list_conflicts(linked_list_t* list, bio_t* bio) {
+  for (linked_list_node_t* node = list->head; node != nullptr; node = node->next) {
+    block_queue_request_t* rq = node_request(node);
+    if ((rq->write || bio->write) && overlaps(rq->lba, rq->sectors, bio->lba, bio->sectors)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct completions_arg {
+  block_queue_t* queue;
+  uint32 seen;
+};
+
+static bool completions_changed(void* arg) {
+  struct completions_arg* ca = (struct completions_arg*)arg;
+  return ca->queue->completions != ca->seen;
+}
+
+// Serve a read from a queued read bio which covers it. Queue lock must be held.
+static bool try_shadow(block_queue_t* queue, bio_t* bio) {
+  if (bio->write) {
+    return false;
+  }
+  for (linked_list_node_t* node = queue->requests.head; node != nullptr; node = node->next) {
+    block_queue_request_t* rq = node_request(node);
+    if (rq->write || !overlaps(rq->lba, rq->sectors, bio->lba, bio->sectors)) {
+      continue;
+    }
+    for (linked_list_node_t* bn = rq->bios.head; bn != nullptr; bn = bn->next) {
+      bio_t* host = node_bio(bn);
+      if (host->lba <= bio->lba && bio->lba + bio->sectors <= host->lba + host->sectors) {
+        bio->shadows = host->shadows;
+        host->shadows = bio;
+        queue->stats.shadowed++;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool can_merge(block_queue_t* queue, block_queue_request_t* rq, bio_t* bio) {
+  return rq->write == bio->write && rq->bios.size < BLOCK_QUEUE_SEGMENTS_MAX &&
+         rq->sectors + bio->sectors <= queue->dev->max_sectors;
+}
+
+// Merge bio into a queued request it's adjacent to. Queue lock must be held.
+static bool try_merge(block_queue_t* queue, bio_t* bio) {
+  for (linked_list_node_t* node = queue->requests.head; node != nullptr; node = node->next) {
+    block_queue_request_t* rq = node_request(node);
+    if (!can_merge(queue, rq, bio)) {
+      continue;
+    }
+    if (rq->lba + rq->sectors == bio->lba) {
+      // back merge, and maybe join the next request too
+      linked_list_append(&rq->bios, &bio->node);
+      rq->sectors += bio->sectors;
+      linked_list_node_t* next_node = node->next;
+      if (next_node != nullptr) {
+        block_queue_request_t* next = node_request(next_node);
+        if (next->write == rq->write && next->lba == rq->lba + rq->sectors &&
+            rq->bios.size + next->bios.size <= BLOCK_QUEUE_SEGMENTS_MAX &&
+            rq->sectors + next->sectors <= queue->dev->max_sectors) {
+          linked_list_remove(&queue->requests, next_node);
+          rq->sectors += next->sectors;
+          linked_list_concate(&rq->bios, &next->bios);
+          kfree(next);
+        }
+      }
+      queue->stats.merges++;
+      return true;
+    }
+    if (bio->lba + bio->sectors == rq->lba) {
+      // front merge
+      linked_list_insert_to_head(&rq->bios, &bio->node);
+      rq->lba = bio->lba;
+      rq->sectors += bio->sectors;
+      queue->stats.merges++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Insert a new request for bio, in lba order. Queue lock must be held.
+static void add_request(block_queue_t* queue, bio_t* bio) {
+  block_queue_request_t* rq = (block_queue_request_t*)kmalloc(sizeof(block_queue_request_t));
+  rq->lba = bio->lba;
+  rq->sectors = bio->sectors;
+  rq->write = bio->write;
+  linked_list_init(&rq->bios);
+  linked_list_append(&rq->bios, &bio->node);
+  rq->node.ptr = rq;
+
+  linked_list_node_t* prev = nullptr;
+  for (linked_list_node_t* node = queue->requests.head; node != nullptr; node = node->next) {
+    if (node_request(node)->lba > rq->lba) {
+      break;
+    }
+    prev = node;
+  }
+  if (prev == nullptr) {
+    linked_list_insert_to_head(&queue->requests, &rq->node);
+  } else {
+    linked_list_insert(&queue->requests, prev, &rq->node);
+  }
+}
+
+// LOOK: next request at or beyond head in the sweep direction, and reverse direction when
+// there is none. Queue lock must be held, and requests not empty.
+static block_queue_request_t* look_pick(block_queue_t* queue) {
+  if (queue->sweep_up) {
+    for (linked_list_node_t* node = queue->requests.head; node != nullptr; node = node->next) {
+      if (node_request(node)->lba >= queue->head_lba) {
+        return node_request(node);
+      }
+    }
+    queue->sweep_up = false;
+  }
+  for (linked_list_node_t* node = queue->requests.tail; node != nullptr; node = node->prev) {
+    if (node_request(node)->lba <= queue->head_lba) {
+      return node_request(node);
+    }
+  }
+  queue->sweep_up = true;
+  return node_request(queue->requests.head);
+}
+
+// The owner may free bio in end_io, or once it sees done, so bio is not touched after.
+static void complete_bio(bio_t* bio, int32 result) {
+  bio->result = result;
+  if (bio->end_io != nullptr) {
+    bio->end_io(bio);
+  } else {
+    bio->done = true;
+  }
+}
+
+static void complete_request(block_queue_request_t* rq) {
+  int32 result = rq->request.result;
+  linked_list_node_t* node = rq->bios.head;
+  while (node != nullptr) {
+    bio_t* bio = node_bio(node);
+    node = node->next;
+    bio_t* shadow = bio->shadows;
+    while (shadow != nullptr) {
+      bio_t* next_shadow = shadow->shadows;
+      if (result == 0) {
+        memcpy(shadow->buffer, bio->buffer + (shadow->lba - bio->lba) * BLOCK_SECTOR_SIZE,
+               shadow->sectors * BLOCK_SECTOR_SIZE);
+      }
+      complete_bio(shadow, result);
+      shadow = next_shadow;
+    }
+    complete_bio(bio, result);
+  }
+}
+
+// Dispatch up to BLOCK_QUEUE_DEPTH requests in LOOK order, and complete them. Returns false
+// if queue is empty.
+static bool dispatch_batch(block_queue_t* queue) {
+  block_queue_request_t* batch[BLOCK_QUEUE_DEPTH];
+  block_request_t* requests[BLOCK_QUEUE_DEPTH];
+  uint32 depth = queue->dev->submit != nullptr ? BLOCK_QUEUE_DEPTH : 1;
+  uint32 num = 0;
+
+  yieldlock_lock(&queue->lock);
+  while (num < depth && queue->requests.size > 0) {
+    block_queue_request_t* rq = look_pick(queue);
+    linked_list_remove(&queue->requests, &rq->node);
+    linked_list_append(&queue->in_flight, &rq->node);
+    queue->head_lba = rq->lba + rq->sectors;
+    batch[num++] = rq;
+  }
+  queue->stats.dispatched += num;
+  yieldlock_unlock(&queue->lock);
+  if (num == 0) {
+    return false;
+  }
+
+  for (uint32 i = 0; i < num; i++) {
+    block_queue_request_t* rq = batch[i];
+    uint32 segments_num = 0;
+    for (linked_list_node_t* node = rq->bios.head; node != nullptr; node = node->next) {
+      bio_t* bio = node_bio(node);
+      rq->segments[segments_num].buffer = bio->buffer;
+      rq->segments[segments_num].sectors = bio->sectors;
+      segments_num++;
+    }
+    rq->request.lba = rq->lba;
+    rq->request.segments = rq->segments;
+    rq->request.segments_num = segments_num;
+    rq->request.write = rq->write;
+    rq->request.flush = false;
+    requests[i] = &rq->request;
+  }
+  block_device_transfer(queue->dev, requests, num);
+
+  for (uint32 i = 0; i < num; i++) {
+    complete_request(batch[i]);
+  }
+  yieldlock_lock(&queue->lock);
+  for (uint32 i = 0; i < num; i++) {
+    linked_list_remove(&queue->in_flight, &batch[i]->node);
+    kfree(batch[i]);
+  }
+  queue->completions++;
+  yieldlock_unlock(&queue->lock);
+  wake_up_all(&queue->complete_wait);
+  return true;
+}
+
+static bool has_requests(void* arg) {
+  return ((block_queue_t*)arg)->requests.size > 0;
+}
+
+// Only one block queue (the hard disk) exists, so the dispatcher thread serves it.
+static block_queue_t* dispatcher_queue = nullptr;
+
+static void dispatcher_thread() {
+  block_queue_t* queue = dispatcher_queue;
+  while (true) {
+    wait_event(&queue->dispatch_wait, has_requests, queue);
+    while (dispatch_batch(queue)) {}
+  }
+}
+
+void submit_bio(block_queue_t* queue, bio_t* bio) {
+  bio->done = false;
+  bio->result = 0;
+  bio->shadows = nullptr;
+  bio->node.ptr = bio;
+
+  yieldlock_lock(&queue->lock);
+  queue->stats.bios++;
+  // A read covered by a queued read needs no I/O of its own.
+  if (try_shadow(queue, bio)) {
+    yieldlock_unlock(&queue->lock);
+    return;
+  }
+  // Do not let elevator reorder overlapping writes, wait for them to finish first.
+  while (list_conflicts(&queue->requests, bio) || list_conflicts(&queue->in_flight, bio)) {
+    struct completions_arg arg = {queue, queue->completions};
+    yieldlock_unlock(&queue->lock);
+    wait_event(&queue->complete_wait, completions_changed, &arg);
+    yieldlock_lock(&queue->lock);
+  }
+  if (!try_merge(queue, bio)) {
+    add_request(queue, bio);
+  }
+  bool start_dispatcher = multi_task_is_enabled() && !queue->dispatcher_started;
+  queue->dispatcher_started = queue->dispatcher_started || start_dispatcher;
+  yieldlock_unlock(&queue->lock);
+
+  if (!multi_task_is_enabled()) {
+    // No dispatcher thread yet, run it inline.
+    while (dispatch_batch(queue)) {}
+    return;
+  }
+  if (start_dispatcher) {
+    dispatcher_queue = queue;
+    start_kernel_thread("block dispatch", dispatcher_thread);
+  }
+  wake_up_one(&queue->dispatch_wait);
+}
+
+static bool bio_is_done(void* arg) {
+  return ((bio_t*)arg)->done;
+}
+
+int32 bio_wait(block_queue_t* queue, bio_t* bio) {
+  if (multi_task_is_enabled()) {
+    wait_event(&queue->complete_wait, bio_is_done, bio);
+  }
+  return bio->result;
+}
+
+void block_queue_print_stats(block_queue_t* queue) {
+  monitor_printf("%s queue: bios %u merged %u shadowed %u dispatched %u\n", queue->dev->name,
+                 queue->stats.bios, queue->stats.merges, queue->stats.shadowed,
+                 queue->stats.dispatched);
+}
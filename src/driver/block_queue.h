@@ -0,0 +1,101 @@
+#ifndef DRIVER_BLOCK_QUEUE_H
+#define DRIVER_BLOCK_QUEUE_H
+
+#include "common/common.h"
+#include "driver/block_device.h"
+#include "sync/yieldlock.h"
+#include "sync/wait_queue.h"
+#include "utils/linked_list.h"
+
+// Block request layer between file systems and disk drivers. Callers submit bios (block I/O
+// units) asynchronously to the per-device queue, where adjacent bios are merged into one
+// device request, and a dispatcher thread issues requests in elevator (LOOK) order: sweep
+// up in lba while there are requests ahead, then sweep down.
+
+// max bios merged into one request
+#define BLOCK_QUEUE_SEGMENTS_MAX   32
+// max requests dispatched to device at once
+#define BLOCK_QUEUE_DEPTH          4
+
+struct bio;
+// Called in dispatcher thread context when bio completes, with bio->result set.
+typedef void (*bio_end_func)(struct bio* bio);
+
+struct bio {
+  uint32 lba;
+  uint32 sectors;
+  char* buffer;
+  bool write;
+
+  // Completion callback and its argument. A bio without end_io is waited by bio_wait.
+  bio_end_func end_io;
+  void* private;
+
+  volatile bool done;
+  int32 result;
+
+  // internal
+  linked_list_node_t node;
+  // reads of the same sectors, served by copying from this bio
+  struct bio* shadows;
+};
+typedef struct bio bio_t;
+
+// A device request, made of bios of consecutive sectors.
+struct block_queue_request {
+  uint32 lba;
+  uint32 sectors;
+  bool write;
+  // bios in lba order
+  linked_list_t bios;
+  linked_list_node_t node;
+  block_request_t request;
+  block_segment_t segments[BLOCK_QUEUE_SEGMENTS_MAX];
+};
+typedef struct block_queue_request block_queue_request_t;
+
+struct block_queue_stats {
+  uint32 bios;
+  uint32 merges;
+  uint32 shadowed;
+  uint32 dispatched;
+};
+typedef struct block_queue_stats block_queue_stats_t;
+
+struct block_queue {
+  block_device_t* dev;
+  // queued requests, sorted by lba
+  linked_list_t requests;
+  // requests being run by device
+  linked_list_t in_flight;
+  // LOOK elevator head position and direction
+  uint32 head_lba;
+  bool sweep_up;
+  yieldlock_t lock;
+  // dispatcher waits for requests
+  wait_queue_t dispatch_wait;
+  // waiters for bio completion
+  wait_queue_t complete_wait;
+  // number of completed batches
+  volatile uint32 completions;
+  bool dispatcher_started;
+  block_queue_stats_t stats;
+};
+typedef struct block_queue block_queue_t;
+
+
+// ****************************************************************************
+void block_queue_init(block_queue_t* queue, block_device_t* dev);
+
+// Queue a bio. It completes later by end_io in dispatcher thread, or before return if
+// multitasking has not started. Must be called in thread context. A bio overlapping a
+// queued or running write (or a write overlapping anything) waits for it first, so that
+// reordering never changes data.
+void submit_bio(block_queue_t* queue, bio_t* bio);
+
+// Block until a bio without end_io completes. Returns bio result.
+int32 bio_wait(block_queue_t* queue, bio_t* bio);
+
+void block_queue_print_stats(block_queue_t* queue);
+
+#endif
@@ -1,43 +1,248 @@
 #include "driver/hard_disk.h"
+#include "driver/ata.h"
+#include "driver/raid0.h"
+#include "driver/virtio_blk.h"
 #include "mem/kheap.h"
 #include "monitor/monitor.h"
 #include "common/stdlib.h"
 #include "utils/math.h"
+#include "utils/debug.h"
 #include "interrupt/interrupt.h"
+#include "interrupt/clock.h"
+#include "sync/yieldlock.h"
+#include "sync/wait_queue.h"
+
+// Bounce buffers for unaligned head and tail sectors of reads. They are preallocated, so
+// reads do not kmalloc, and aligned sectors are read directly into caller's buffer.
+static char* bounce_buffers[BOUNCE_BUFFERS_NUM];
+// bit i is set if bounce_buffers[i] is free
+static uint32 bounce_buffers_free;
+static yieldlock_t bounce_buffers_lock;
+static wait_queue_t bounce_buffers_wait;
+
+// block device backend found at boot, and its request queue
+static block_device_t* disk = nullptr;
+static block_queue_t disk_queue;
 
 static void disk_interrupt_handler() {}
 
+// The boot area stays unstriped on primary disk, where loader reads kernel from.
+static block_device_t* init_ata_disk() {
+  block_device_t* primary = init_ata(ATA_PRIMARY);
+  if (primary == nullptr || !HARD_DISK_RAID0) {
+    return primary;
+  }
+  block_device_t* secondary = init_ata(ATA_SECONDARY);
+  if (secondary == nullptr) {
+    return primary;
+  }
+  block_device_t* members[2] = {primary, secondary};
+  return init_raid0(members, 2, HARD_DISK_BOOT_SECTORS);
+}
+
 void init_hard_disk() {
-  // Ignore disk interrupt.
-  register_interrupt_handler(IRQ14_INT_NUM, &disk_interrupt_handler);
+  // Ignore secondary ATA bus interrupt unless the secondary channel is used, then ata driver
+  // handles it, as well as primary bus interrupt.
   register_interrupt_handler(IRQ15_INT_NUM, &disk_interrupt_handler);
+  // Prefer virtio-blk, it keeps multiple requests in flight.
+  disk = init_virtio_blk();
+  if (disk == nullptr) {
+    disk = init_ata_disk();
+  }
+  if (disk == nullptr) {
+    monitor_printf("no hard disk found\n");
+    PANIC();
+  }
+  block_queue_init(&disk_queue, disk);
+
+  // Do NOT allocate buffer on kernel stack!
+  for (uint32 i = 0; i < BOUNCE_BUFFERS_NUM; i++) {
+    bounce_buffers[i] = (char*)kmalloc(SECTOR_SIZE);
+  }
+  bounce_buffers_free = (1 << BOUNCE_BUFFERS_NUM) - 1;
+  yieldlock_init(&bounce_buffers_lock);
+  wait_queue_init(&bounce_buffers_wait);
 }
 
-extern void read_disk(char* buffer, uint32 start_sector, uint32 sector_num);
+block_device_t* get_hard_disk() {
+  return disk;
+}
 
-static void read_sector(char* buffer, uint32 sector) {
-  read_disk(buffer, sector, 1);
+block_queue_t* get_hard_disk_queue() {
+  return &disk_queue;
 }
 
-void read_hard_disk(char* buffer, uint32 start, uint32 length) {
+int32 flush_hard_disk() {
+  if (disk->flush == nullptr) {
+    return 0;
+  }
+  return disk->flush(disk);
+}
+
+static uint32 bits_count(uint32 bits) {
+  uint32 count = 0;
+  for (; bits != 0; bits &= bits - 1) {
+    count++;
+  }
+  return count;
+}
+
+// Take num bounce buffers at once. A read holding one buffer while waiting for another
+// could deadlock with other readers.
+static void get_bounce_buffers(uint32* indexes, uint32 num) {
+  yieldlock_lock(&bounce_buffers_lock);
+  while (bits_count(bounce_buffers_free) < num) {
+    wait_queue_sleep(&bounce_buffers_wait, &bounce_buffers_lock);
+  }
+  for (uint32 i = 0; i < num; i++) {
+    uint32 index;
+    asm volatile("bsf %1, %0" : "=r"(index) : "r"(bounce_buffers_free));
+    bounce_buffers_free &= ~(1 << index);
+    indexes[i] = index;
+  }
+  yieldlock_unlock(&bounce_buffers_lock);
+}
+
+static void put_bounce_buffers(uint32* indexes, uint32 num) {
+  if (num == 0) {
+    return;
+  }
+  yieldlock_lock(&bounce_buffers_lock);
+  for (uint32 i = 0; i < num; i++) {
+    bounce_buffers_free |= (1 << indexes[i]);
+  }
+  yieldlock_unlock(&bounce_buffers_lock);
+  wake_up_all(&bounce_buffers_wait);
+}
+
+// One device request of a read.
+struct disk_chunk {
+  block_request_t request;
+  block_segment_t segments[3];
+};
+typedef struct disk_chunk disk_chunk_t;
+
+static int32 run_chunks(disk_chunk_t* chunks, uint32 num) {
+  block_request_t* requests[HARD_DISK_BATCH_MAX];
+  for (uint32 i = 0; i < num; i++) {
+    requests[i] = &chunks[i].request;
+  }
+  return block_device_transfer(disk, requests, num);
+}
+
+// Sectors of [start, end) are read by requests of up to max_sectors each, and up to
+// HARD_DISK_BATCH_MAX requests are submitted together. Aligned sectors go directly into
+// buffer, and partial head and tail sectors go to bounce buffers.
+int32 read_hard_disk(char* buffer, uint32 start, uint32 length) {
+  if (length == 0) {
+    return 0;
+  }
   uint32 end = start + length;
+  uint32 first = start / SECTOR_SIZE;
+  uint32 last = (end - 1) / SECTOR_SIZE;
+  bool head_partial = (start % SECTOR_SIZE != 0) || (end < (first + 1) * SECTOR_SIZE);
+  bool tail_partial = (end % SECTOR_SIZE != 0) && (last != first || !head_partial);
 
-  uint32 start_sector = start / SECTOR_SIZE;
-  uint32 end_sector = (end - 1) / SECTOR_SIZE + 1;
+  uint32 bounce[2];
+  uint32 bounce_num = (head_partial ? 1 : 0) + (tail_partial ? 1 : 0);
+  get_bounce_buffers(bounce, bounce_num);
+  char* head_buffer = head_partial ? bounce_buffers[bounce[0]] : nullptr;
+  char* tail_buffer = tail_partial ? bounce_buffers[bounce[bounce_num - 1]] : nullptr;
 
-  // Do NOT allocate buffer on kernel stack!
-  char* sector_buffer = (char*)kmalloc(SECTOR_SIZE);
+  disk_chunk_t chunks[HARD_DISK_BATCH_MAX];
+  uint32 chunks_num = 0;
+  int32 ret = 0;
+  for (uint32 sector = first; sector <= last && ret == 0;) {
+    uint32 chunk_end = min(last + 1, sector + disk->max_sectors);
+    disk_chunk_t* chunk = &chunks[chunks_num++];
+    block_request_t* request = &chunk->request;
+    request->lba = sector;
+    request->segments = chunk->segments;
+    request->segments_num = 0;
+    request->write = false;
+    request->flush = false;
+
+    uint32 middle_first = sector;
+    uint32 middle_end = chunk_end;
+    if (sector == first && head_partial) {
+      chunk->segments[request->segments_num++] = (block_segment_t){head_buffer, 1};
+      middle_first++;
+    }
+    if (chunk_end == last + 1 && tail_partial) {
+      middle_end--;
+    }
+    if (middle_end > middle_first) {
+      chunk->segments[request->segments_num++] = (block_segment_t){
+          buffer + (middle_first * SECTOR_SIZE - start), middle_end - middle_first};
+    }
+    if (middle_end < chunk_end) {
+      chunk->segments[request->segments_num++] = (block_segment_t){tail_buffer, 1};
+    }
+
+    sector = chunk_end;
+    if (chunks_num == HARD_DISK_BATCH_MAX || sector > last) {
+      ret = run_chunks(chunks, chunks_num);
+      chunks_num = 0;
+    }
+  }
+
+  if (ret == 0) {
+    if (head_partial) {
+      uint32 copy_end = min((first + 1) * SECTOR_SIZE, end);
+      memcpy(buffer, head_buffer + start % SECTOR_SIZE, copy_end - start);
+    }
+    if (tail_partial) {
+      memcpy(buffer + (last * SECTOR_SIZE - start), tail_buffer, end - last * SECTOR_SIZE);
+    }
+  }
+  put_bounce_buffers(bounce, bounce_num);
+  return ret;
+}
 
-  for (uint32 i = start_sector; i < end_sector; i++) {
-    read_sector(sector_buffer, i);
 
-    uint32 copy_start_addr = max(i * SECTOR_SIZE, start);
-    uint32 copy_end_addr = min((i + 1) * SECTOR_SIZE, end);
-    uint32 copy_size = copy_end_addr - copy_start_addr;
-    memcpy(buffer, sector_buffer + copy_start_addr - i * SECTOR_SIZE, copy_size);
-    buffer += (copy_size);
+// ****************************** unit test ***********************************
+static uint32 benchmark_coalesced_read(char* buffer, uint32 size, uint32 chunk) {
+  uint64 start_ns = clock_monotonic_ns();
+  for (uint32 offset = 0; offset < size; offset += chunk) {
+    read_hard_disk(buffer, offset, chunk);
   }
+  return udiv64_32(clock_monotonic_ns() - start_ns, 1000000, nullptr);
+}
 
-  kfree(sector_buffer);
+// Throughput in 0.1 MB/s, 0 if the mode did not run.
+static uint32 benchmark_rate(uint32 size_mb, uint32 ms) {
+  return ms == 0 ? 0 : size_mb * 10000 / ms;
 }
 
+// Compare throughput of one read command per sector against coalesced reads, and on ata,
+// PIO against DMA. Must run after multitasking starts, as DMA completes by IRQ.
+void hard_disk_benchmark(uint32 size_mb) {
+  uint32 size = size_mb * 1024 * 1024;
+  uint32 chunk = DISK_READ_SECTORS_MAX * SECTOR_SIZE;
+  char* buffer = (char*)kmalloc(chunk);
+  bool dma = ata_get_device(ATA_PRIMARY)->dma;
+
+  ata_set_dma(false);
+  uint64 start_ns = clock_monotonic_ns();
+  for (uint32 sector = 0; sector < size / SECTOR_SIZE; sector++) {
+    block_segment_t segment = {buffer, 1};
+    disk->read(disk, sector, &segment, 1);
+  }
+  uint32 single_ms = udiv64_32(clock_monotonic_ns() - start_ns, 1000000, nullptr);
+  uint32 pio_ms = benchmark_coalesced_read(buffer, size, chunk);
+
+  uint32 dma_ms = 0;
+  if (ata_set_dma(true)) {
+    dma_ms = benchmark_coalesced_read(buffer, size, chunk);
+  }
+  ata_set_dma(dma);
+
+  kfree(buffer);
+  uint32 single_rate = benchmark_rate(size_mb, single_ms);
+  uint32 pio_rate = benchmark_rate(size_mb, pio_ms);
+  uint32 dma_rate = benchmark_rate(size_mb, dma_ms);
+  monitor_printf("%s read %u MB: per-sector %u.%u MB/s, coalesced %u.%u MB/s, "
+                 "ata dma %u.%u MB/s\n", disk->name, size_mb,
+                 single_rate / 10, single_rate % 10, pio_rate / 10, pio_rate % 10,
+                 dma_rate / 10, dma_rate % 10);
+}
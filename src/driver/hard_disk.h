@@ -2,12 +2,40 @@
 #define DRIVER_HARD_DISK_H
 
 #include "common/common.h"
+#include "driver/block_device.h"
+#include "driver/block_queue.h"
 
 #define SECTOR_SIZE  512
+// max sectors per disk read command
+#define DISK_READ_SECTORS_MAX  256
+// max device requests of one read submitted together
+#define HARD_DISK_BATCH_MAX    8
+// concurrent reads which have unaligned head or tail sectors
+#define BOUNCE_BUFFERS_NUM     4
+// mbr, loader and kernel, before the file system partition
+#define HARD_DISK_BOOT_SECTORS 2057
+
+// Stripe the disk over the ata masters of primary and secondary channels, if both are
+// present. The image must be written striped too, see "make image_raid0".
+#define HARD_DISK_RAID0        false
 
 void init_hard_disk();
 
-void read_hard_disk(char* buffer, uint32 start, uint32 length);
+// Block device the hard disk is read through, virtio-blk, ata or raid0 of ata disks.
+block_device_t* get_hard_disk();
+
+// Request queue of hard disk, which file systems submit bios to.
+block_queue_t* get_hard_disk_queue();
+
+// Read length bytes from disk byte offset start, directly from device. Returns 0 on success,
+// -1 on disk error.
+int32 read_hard_disk(char* buffer, uint32 start, uint32 length);
+
+// Flush device write cache, so that all completed writes survive power loss.
+int32 flush_hard_disk();
+
+// ****************************** unit test ***********************************
+void hard_disk_benchmark(uint32 size_mb);
 
 
 #endif
@@ -4,10 +4,10 @@
 #include "common/stdlib.h"
 #include "monitor/monitor.h"
 #include "sync/spinlock.h"
+#include "sync/wait_queue.h"
 #include "task/scheduler.h"
 #include "interrupt/interrupt.h"
 #include "utils/debug.h"
-#include "utils/linked_list.h"
 
 #define KEYBOARD_BUF_SIZE 1024
 
@@ -20,7 +20,7 @@ typedef struct {
 
 static buffer_queue_t queue;
 
-static linked_list_t waiting_tasks;
+static wait_queue_t waiting_tasks;
 
 static spinlock_t keyboard_lock;
 
@@ -62,23 +62,23 @@ static int32 read_keyboard_char_impl() {
   return KH_GETCHAR(augchar);
 }
 
+// Checked with interrupt disabled, so keyboard interrupt can not race with it.
+static bool keyboard_has_input(void* arg) {
+  return queue.size > 0;
+}
+
 int32 read_keyboard_char() {
-  spinlock_lock_irqsave(&keyboard_lock);
   int32 c;
   while (1) {
+    spinlock_lock_irqsave(&keyboard_lock);
     c = read_keyboard_char_impl();
+    spinlock_unlock_irqrestore(&keyboard_lock);
     if (c != -1) {
       break;
     }
     //monitor_printf("keyboard waiting thread %u\n", get_crt_thread()->id);
-    linked_list_append(&waiting_tasks, get_crt_thread_node());
-    schedule_mark_thread_block();
-    spinlock_unlock_irqrestore(&keyboard_lock);
-    schedule_thread_yield();
-
-    spinlock_lock_irqsave(&keyboard_lock);
+    wait_event(&waiting_tasks, keyboard_has_input, nullptr);
   }
-  spinlock_unlock_irqrestore(&keyboard_lock);
   return c;
 }
 
@@ -87,19 +87,9 @@ static void keyboard_interrupt_handler() {
 
   spinlock_lock(&keyboard_lock);
   enqueue(scancode);
-  linked_list_t waiting_tasks_get;
-  linked_list_move(&waiting_tasks_get, &waiting_tasks);
   spinlock_unlock(&keyboard_lock);
 
-  thread_node_t* node = waiting_tasks_get.head;
-  while (node != nullptr) {
-    thread_node_t* next_node = node->next;
-    linked_list_remove(&waiting_tasks_get, node);
-    //monitor_printf("wake up keyboard waiting thread %u\n", ((tcb_t*)node->ptr)->id);
-    add_thread_node_to_schedule_head(node);
-    //break;
-    node = next_node;
-  }
+  wake_up_all(&waiting_tasks);
 
   // Activate waiting thread immediately.
   get_crt_thread()->need_reschedule = true;
@@ -107,7 +97,7 @@ static void keyboard_interrupt_handler() {
 
 void init_keyboard() {
   spinlock_init(&keyboard_lock);
-  linked_list_init(&waiting_tasks);
+  wait_queue_init(&waiting_tasks);
 
   // Explicitly set queue memory to avoid page fault for this part of memory.
   memset(&queue, 0, sizeof(buffer_queue_t));
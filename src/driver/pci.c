@@ -0,0 +1,84 @@
+#include "common/io.h"
+#include "driver/pci.h"
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+#define PCI_BUSES_NUM       256
+#define PCI_DEVICES_NUM     32
+#define PCI_FUNCTIONS_NUM   8
+
+static uint32 config_address(uint8 bus, uint8 device, uint8 function, uint8 offset) {
+  return (1 << 31) | ((uint32)bus << 16) | ((uint32)device << 11) |
+         ((uint32)function << 8) | (offset & 0xFC);
+}
+
+static uint32 config_read(uint8 bus, uint8 device, uint8 function, uint8 offset) {
+  outl(PCI_CONFIG_ADDRESS, config_address(bus, device, function, offset));
+  return inl(PCI_CONFIG_DATA);
+}
+
+uint32 pci_config_read(pci_device_t* dev, uint8 offset) {
+  return config_read(dev->bus, dev->device, dev->function, offset);
+}
+
+void pci_config_write(pci_device_t* dev, uint8 offset, uint32 value) {
+  outl(PCI_CONFIG_ADDRESS, config_address(dev->bus, dev->device, dev->function, offset));
+  outl(PCI_CONFIG_DATA, value);
+}
+
+typedef bool (*pci_match_func)(pci_device_t* dev, uint32 arg1, uint32 arg2);
+
+// Scan all bus / device / function, and fill dev with the first one that matches.
+static bool pci_scan(pci_match_func match, uint32 arg1, uint32 arg2, pci_device_t* dev) {
+  for (uint32 bus = 0; bus < PCI_BUSES_NUM; bus++) {
+    for (uint32 device = 0; device < PCI_DEVICES_NUM; device++) {
+      for (uint32 function = 0; function < PCI_FUNCTIONS_NUM; function++) {
+        uint32 id = config_read(bus, device, function, PCI_CONFIG_VENDOR_ID);
+        if ((id & 0xFFFF) == 0xFFFF) {
+          if (function == 0) {
+            // no device
+            break;
+          }
+          continue;
+        }
+        uint32 class_reg = config_read(bus, device, function, PCI_CONFIG_CLASS);
+        dev->bus = bus;
+        dev->device = device;
+        dev->function = function;
+        dev->vendor_id = id & 0xFFFF;
+        dev->device_id = id >> 16;
+        dev->class_code = class_reg >> 24;
+        dev->subclass = (class_reg >> 16) & 0xFF;
+        dev->prog_if = (class_reg >> 8) & 0xFF;
+        if (match(dev, arg1, arg2)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+static bool match_class(pci_device_t* dev, uint32 class_code, uint32 subclass) {
+  return dev->class_code == class_code && dev->subclass == subclass;
+}
+
+static bool match_id(pci_device_t* dev, uint32 vendor_id, uint32 device_id) {
+  return dev->vendor_id == vendor_id && dev->device_id == device_id;
+}
+
+bool pci_find_class(uint8 class_code, uint8 subclass, pci_device_t* dev) {
+  return pci_scan(match_class, class_code, subclass, dev);
+}
+
+bool pci_find_device(uint16 vendor_id, uint16 device_id, pci_device_t* dev) {
+  return pci_scan(match_id, vendor_id, device_id, dev);
+}
+
+void pci_enable_bus_master(pci_device_t* dev) {
+  uint32 command = pci_config_read(dev, PCI_CONFIG_COMMAND);
+  // Keep the status half (upper 16 bits) zero, writing 1s there clears its bits.
+  command = (command & 0xFFFF) | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_BUS_MASTER;
+  pci_config_write(dev, PCI_CONFIG_COMMAND, command);
+}
@@ -0,0 +1,52 @@
+#ifndef DRIVER_PCI_H
+#define DRIVER_PCI_H
+
+#include "common/common.h"
+
+// PCI configuration space access through mechanism #1 (ports 0xCF8 / 0xCFC).
+
+#define PCI_CONFIG_VENDOR_ID    0x00
+#define PCI_CONFIG_COMMAND      0x04
+#define PCI_CONFIG_CLASS        0x08
+#define PCI_CONFIG_BAR0         0x10
+#define PCI_CONFIG_BAR4         0x20
+#define PCI_CONFIG_INTERRUPT    0x3C
+
+#define PCI_COMMAND_IO          (1 << 0)
+#define PCI_COMMAND_MEMORY      (1 << 1)
+#define PCI_COMMAND_BUS_MASTER  (1 << 2)
+
+#define PCI_CLASS_STORAGE       0x01
+#define PCI_SUBCLASS_IDE        0x01
+
+// I/O space BARs have bit 0 set, and the port base in the other bits.
+#define PCI_BAR_IO              0x01
+#define PCI_BAR_IO_MASK         0xFFFFFFFC
+
+struct pci_device {
+  uint8 bus;
+  uint8 device;
+  uint8 function;
+  uint16 vendor_id;
+  uint16 device_id;
+  uint8 class_code;
+  uint8 subclass;
+  uint8 prog_if;
+};
+typedef struct pci_device pci_device_t;
+
+
+// ****************************************************************************
+uint32 pci_config_read(pci_device_t* dev, uint8 offset);
+void pci_config_write(pci_device_t* dev, uint8 offset, uint32 value);
+
+// Find the first function of class / subclass on all buses. Returns false if not found.
+bool pci_find_class(uint8 class_code, uint8 subclass, pci_device_t* dev);
+
+// Find function by vendor / device id. Returns false if not found.
+bool pci_find_device(uint16 vendor_id, uint16 device_id, pci_device_t* dev);
+
+// Enable bus mastering, and I/O & memory space decoding.
+void pci_enable_bus_master(pci_device_t* dev);
+
+#endif
@@ -0,0 +1,353 @@
+#include "common/stdlib.h"
+#include "driver/raid0.h"
+#include "mem/paging.h"
+#include "monitor/monitor.h"
+#include "sync/yieldlock.h"
+#include "sync/wait_queue.h"
+#include "task/scheduler.h"
+#include "utils/debug.h"
+#include "utils/linked_list.h"
+#include "utils/math.h"
+
+struct raid0_request;
+
+// Part of an array request on one member, of consecutive member sectors.
+struct raid0_sub_request {
+  block_request_t request;
+  block_segment_t segments[RAID0_SEGMENTS_MAX];
+  struct raid0_request* parent;
+  linked_list_node_t node;
+};
+typedef struct raid0_sub_request raid0_sub_request_t;
+
+struct raid0_request {
+  bool in_use;
+  block_request_t* request;
+  raid0_sub_request_t subs[RAID0_MEMBERS_MAX];
+  uint32 pending;
+  int32 result;
+};
+typedef struct raid0_request raid0_request_t;
+
+struct raid0_member {
+  block_device_t* dev;
+  // first member sector of stripes
+  uint32 start;
+  // sub-requests waiting for the member worker
+  linked_list_t queue;
+  wait_queue_t queue_wait;
+};
+typedef struct raid0_member raid0_member_t;
+
+static raid0_member_t members[RAID0_MEMBERS_MAX];
+static uint32 members_num;
+static uint32 linear_sectors;
+
+static raid0_request_t requests[RAID0_REQUESTS_MAX];
+// Protects requests and member queues.
+static yieldlock_t raid_lock;
+// Waiters for array request completion, or for a free request.
+static wait_queue_t raid_wait;
+static bool workers_started = false;
+static uint32 workers_num = 0;
+
+static block_device_t raid0_device;
+
+// Map array lba to member and member lba. Returns sectors left in the chunk, or in the
+// linear area.
+static uint32 map_sector(uint32 lba, uint32* member, uint32* member_lba) {
+  if (lba < linear_sectors) {
+    *member = 0;
+    *member_lba = lba;
+    return linear_sectors - lba;
+  }
+  uint32 offset = lba - linear_sectors;
+  uint32 chunk = offset / RAID0_CHUNK_SECTORS;
+  uint32 chunk_offset = offset % RAID0_CHUNK_SECTORS;
+  *member = chunk % members_num;
+  *member_lba = members[*member].start + chunk / members_num * RAID0_CHUNK_SECTORS +
+                chunk_offset;
+  return RAID0_CHUNK_SECTORS - chunk_offset;
+}
+
+// Split request into member sub-requests. Successive chunks of a member are consecutive
+// member sectors, so each member gets one sub-request. Returns false if the request does
+// not fit in sub-request segments.
+static bool split_request(raid0_request_t* raid_request) {
+  block_request_t* request = raid_request->request;
+  for (uint32 i = 0; i < members_num; i++) {
+    raid0_sub_request_t* sub = &raid_request->subs[i];
+    sub->parent = raid_request;
+    sub->request.segments = sub->segments;
+    sub->request.segments_num = 0;
+    sub->request.write = request->write;
+    sub->request.flush = false;
+  }
+
+  uint32 lba = request->lba;
+  for (uint32 i = 0; i < request->segments_num; i++) {
+    char* buffer = request->segments[i].buffer;
+    uint32 left = request->segments[i].sectors;
+    while (left > 0) {
+      uint32 member, member_lba;
+      uint32 sectors = min(left, map_sector(lba, &member, &member_lba));
+      block_request_t* sub = &raid_request->subs[member].request;
+      block_segment_t* last = sub->segments_num > 0 ?
+          &sub->segments[sub->segments_num - 1] : nullptr;
+      if (last == nullptr) {
+        sub->lba = member_lba;
+      }
+      if (last != nullptr && last->buffer + last->sectors * BLOCK_SECTOR_SIZE == buffer) {
+        last->sectors += sectors;
+      } else {
+        if (sub->segments_num == RAID0_SEGMENTS_MAX) {
+          return false;
+        }
+        sub->segments[sub->segments_num++] = (block_segment_t){buffer, sectors};
+      }
+      buffer += sectors * BLOCK_SECTOR_SIZE;
+      left -= sectors;
+      lba += sectors;
+    }
+  }
+  return true;
+}
+
+static bool has_free_request(void* arg) {
+  for (uint32 i = 0; i < RAID0_REQUESTS_MAX; i++) {
+    if (!requests[i].in_use) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static raid0_request_t* alloc_request() {
+  while (true) {
+    yieldlock_lock(&raid_lock);
+    for (uint32 i = 0; i < RAID0_REQUESTS_MAX; i++) {
+      if (!requests[i].in_use) {
+        requests[i].in_use = true;
+        yieldlock_unlock(&raid_lock);
+        return &requests[i];
+      }
+    }
+    yieldlock_unlock(&raid_lock);
+    wait_event(&raid_wait, has_free_request, nullptr);
+  }
+}
+
+static void complete_sub_request(raid0_sub_request_t* sub) {
+  raid0_request_t* raid_request = sub->parent;
+  yieldlock_lock(&raid_lock);
+  if (sub->request.result != 0) {
+    raid_request->result = -1;
+  }
+  raid_request->pending--;
+  bool done = (raid_request->pending == 0);
+  if (done) {
+    block_request_t* request = raid_request->request;
+    raid_request->in_use = false;
+    request->result = raid_request->result;
+    request->done = true;
+  }
+  yieldlock_unlock(&raid_lock);
+  if (done) {
+    wake_up_all(&raid_wait);
+  }
+}
+
+static bool member_has_work(void* arg) {
+  return ((raid0_member_t*)arg)->queue.size > 0;
+}
+
+// Each worker serves one member, and takes its member index when it starts.
+static void raid0_worker() {
+  yieldlock_lock(&raid_lock);
+  raid0_member_t* member = &members[workers_num++];
+  yieldlock_unlock(&raid_lock);
+
+  while (true) {
+    wait_event(&member->queue_wait, member_has_work, member);
+    yieldlock_lock(&raid_lock);
+    linked_list_node_t* head = member->queue.head;
+    linked_list_remove(&member->queue, head);
+    yieldlock_unlock(&raid_lock);
+
+    raid0_sub_request_t* sub = (raid0_sub_request_t*)head->ptr;
+    block_request_t* request = &sub->request;
+    block_device_transfer(member->dev, &request, 1);
+    complete_sub_request(sub);
+  }
+}
+
+static void start_workers() {
+  yieldlock_lock(&raid_lock);
+  bool start = !workers_started;
+  workers_started = true;
+  yieldlock_unlock(&raid_lock);
+  if (!start) {
+    return;
+  }
+  for (uint32 i = 0; i < members_num; i++) {
+    start_kernel_thread("raid0 worker", raid0_worker);
+  }
+}
+
+static void fail_request(raid0_request_t* raid_request) {
+  block_request_t* request = raid_request->request;
+  yieldlock_lock(&raid_lock);
+  raid_request->in_use = false;
+  yieldlock_unlock(&raid_lock);
+  request->result = -1;
+  request->done = true;
+}
+
+// Workers are threads of the kernel process, so they can only reach buffers in kernel space.
+static bool in_kernel_space(block_request_t* request) {
+  for (uint32 i = 0; i < request->segments_num; i++) {
+    if ((uint32)request->segments[i].buffer < KERNEL_VADDR_START) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void raid0_submit(block_device_t* dev, block_request_t** reqs, uint32 num) {
+  // Workers can only run after multitasking starts, run sub-requests inline before that.
+  bool workers = multi_task_is_enabled() && !is_in_irq_context();
+  if (workers) {
+    start_workers();
+  }
+
+  for (uint32 i = 0; i < num; i++) {
+    block_request_t* request = reqs[i];
+    request->done = false;
+    // User space buffers are only mapped in the submitter, which runs their sub-requests.
+    bool async = workers && in_kernel_space(request);
+    raid0_request_t* raid_request = alloc_request();
+    raid_request->request = request;
+    raid_request->result = 0;
+    if (!split_request(raid_request)) {
+      fail_request(raid_request);
+      continue;
+    }
+    // The request may complete, and its slot be reused, as soon as the last sub-request
+    // is queued, so do not touch it after that.
+    raid0_sub_request_t* subs[RAID0_MEMBERS_MAX];
+    uint32 subs_num = 0;
+    for (uint32 m = 0; m < members_num; m++) {
+      if (raid_request->subs[m].request.segments_num > 0) {
+        subs[subs_num++] = &raid_request->subs[m];
+      }
+    }
+    if (subs_num == 0) {
+      fail_request(raid_request);
+      continue;
+    }
+    raid_request->pending = subs_num;
+
+    for (uint32 j = 0; j < subs_num; j++) {
+      raid0_sub_request_t* sub = subs[j];
+      raid0_member_t* member = &members[sub - raid_request->subs];
+      if (!async) {
+        block_request_t* sub_request = &sub->request;
+        block_device_transfer(member->dev, &sub_request, 1);
+        complete_sub_request(sub);
+        continue;
+      }
+      sub->node.ptr = sub;
+      yieldlock_lock(&raid_lock);
+      linked_list_append(&member->queue, &sub->node);
+      yieldlock_unlock(&raid_lock);
+      wake_up_one(&member->queue_wait);
+    }
+  }
+}
+
+static bool request_is_done(void* arg) {
+  return ((block_request_t*)arg)->done;
+}
+
+static void raid0_wait(block_device_t* dev, block_request_t* request) {
+  if (request->done) {
+    return;
+  }
+  wait_event(&raid_wait, request_is_done, request);
+}
+
+static int32 raid0_transfer(
+    uint32 lba, block_segment_t* segments, uint32 segments_num, bool write) {
+  block_request_t request;
+  request.lba = lba;
+  request.segments = segments;
+  request.segments_num = segments_num;
+  request.write = write;
+  request.flush = false;
+  block_request_t* reqs[1] = {&request};
+  raid0_submit(&raid0_device, reqs, 1);
+  raid0_wait(&raid0_device, &request);
+  return request.result;
+}
+
+static int32 raid0_read(
+    block_device_t* dev, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return raid0_transfer(lba, segments, segments_num, false);
+}
+
+static int32 raid0_write(
+    block_device_t* dev, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return raid0_transfer(lba, segments, segments_num, true);
+}
+
+static int32 raid0_flush(block_device_t* dev) {
+  int32 ret = 0;
+  for (uint32 i = 0; i < members_num; i++) {
+    block_device_t* member = members[i].dev;
+    if (member->flush != nullptr && member->flush(member) != 0) {
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
+static block_device_t raid0_device = {
+  .name = "raid0",
+  .read = raid0_read,
+  .write = raid0_write,
+  .flush = raid0_flush,
+  .submit = raid0_submit,
+  .wait = raid0_wait,
+};
+
+block_device_t* init_raid0(block_device_t** devs, uint32 num, uint32 linear) {
+  ASSERT(num > 0 && num <= RAID0_MEMBERS_MAX);
+  ASSERT(devs[0]->sectors >= linear);
+  members_num = num;
+  linear_sectors = linear;
+
+  // Every member holds the same number of whole chunks. An array request may fall entirely
+  // in the linear area of member 0, so it's no larger than any member request.
+  uint32 chunks = 0xFFFFFFFF;
+  uint32 max_sectors = 0xFFFFFFFF;
+  for (uint32 i = 0; i < num; i++) {
+    raid0_member_t* member = &members[i];
+    member->dev = devs[i];
+    member->start = (i == 0) ? linear : 0;
+    linked_list_init(&member->queue);
+    wait_queue_init(&member->queue_wait);
+    chunks = min(chunks, (devs[i]->sectors - member->start) / RAID0_CHUNK_SECTORS);
+    max_sectors = min(max_sectors, devs[i]->max_sectors);
+  }
+  ASSERT(max_sectors >= RAID0_CHUNK_SECTORS);
+
+  memset(requests, 0, sizeof(requests));
+  yieldlock_init(&raid_lock);
+  wait_queue_init(&raid_wait);
+
+  raid0_device.sectors = linear + chunks * num * RAID0_CHUNK_SECTORS;
+  raid0_device.max_sectors = max_sectors / RAID0_CHUNK_SECTORS * RAID0_CHUNK_SECTORS;
+  monitor_printf("raid0: %u disks, %u sectors, chunk %u sectors\n",
+                 num, raid0_device.sectors, RAID0_CHUNK_SECTORS);
+  return &raid0_device;
+}
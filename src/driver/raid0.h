@@ -0,0 +1,35 @@
+#ifndef DRIVER_RAID0_H
+#define DRIVER_RAID0_H
+
+#include "common/common.h"
+#include "driver/block_device.h"
+
+// Striping (RAID-0) block device over member devices, e.g. the ata disks of both IDE
+// channels. The array is cut into chunks of RAID0_CHUNK_SECTORS, which are placed on
+// members round-robin. A request is split into one sub-request per member, and each member
+// has a worker thread running its sub-requests, so members transfer at the same time. With
+// the block queue dispatching several requests together, sequential reads keep all members
+// busy.
+//
+// Workers belong to the kernel process, so only requests with all buffers in kernel space go
+// to them. Requests with user space buffers run their sub-requests one after another in the
+// submitting thread, which has the buffers mapped.
+//
+// The first linear_sectors of the array are not striped, they map to the same sectors of
+// member 0. This keeps the boot area, which loader reads from the first disk, in place.
+// Stripes then start right after it on member 0, and at sector 0 on other members.
+
+#define RAID0_MEMBERS_MAX     4
+// 64KB
+#define RAID0_CHUNK_SECTORS   128
+// max segments of a sub-request
+#define RAID0_SEGMENTS_MAX    64
+// max array requests in flight
+#define RAID0_REQUESTS_MAX    8
+
+
+// ****************************************************************************
+// Build the array over members. Returns its block device, "raid0".
+block_device_t* init_raid0(block_device_t** members, uint32 members_num, uint32 linear_sectors);
+
+#endif
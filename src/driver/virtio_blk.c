@@ -0,0 +1,458 @@
+#include "common/io.h"
+#include "common/stdlib.h"
+#include "driver/pci.h"
+#include "driver/virtio_blk.h"
+#include "interrupt/interrupt.h"
+#include "mem/dma.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+#include "monitor/monitor.h"
+#include "sync/spinlock.h"
+#include "sync/wait_queue.h"
+#include "task/scheduler.h"
+#include "utils/math.h"
+
+// legacy virtio PCI registers, offsets from BAR0
+#define VIRTIO_REG_DEVICE_FEATURES  0x00
+#define VIRTIO_REG_GUEST_FEATURES   0x04
+#define VIRTIO_REG_QUEUE_PFN        0x08
+#define VIRTIO_REG_QUEUE_SIZE       0x0C
+#define VIRTIO_REG_QUEUE_SELECT     0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY     0x10
+#define VIRTIO_REG_DEVICE_STATUS    0x12
+#define VIRTIO_REG_ISR_STATUS       0x13
+// virtio-blk config, capacity in sectors
+#define VIRTIO_REG_BLK_CAPACITY     0x14
+
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FAILED        0x80
+
+// device has a volatile write cache and accepts flush requests
+#define VIRTIO_BLK_F_FLUSH          (1 << 9)
+
+#define VIRTIO_ISR_QUEUE            0x01
+
+#define VRING_DESC_F_NEXT           0x01
+#define VRING_DESC_F_WRITE          0x02
+#define VRING_USED_F_NO_NOTIFY      0x01
+// legacy layout aligns used ring to a page
+#define VRING_ALIGN                 PAGE_SIZE
+
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_T_FLUSH          4
+#define VIRTIO_BLK_S_OK             0
+
+struct vring_desc {
+  uint64 addr;
+  uint32 len;
+  uint16 flags;
+  uint16 next;
+} __attribute__((packed));
+typedef struct vring_desc vring_desc_t;
+
+struct vring_avail {
+  uint16 flags;
+  volatile uint16 idx;
+  uint16 ring[];
+} __attribute__((packed));
+typedef struct vring_avail vring_avail_t;
+
+struct vring_used_elem {
+  uint32 id;
+  uint32 len;
+} __attribute__((packed));
+typedef struct vring_used_elem vring_used_elem_t;
+
+struct vring_used {
+  volatile uint16 flags;
+  volatile uint16 idx;
+  vring_used_elem_t ring[];
+} __attribute__((packed));
+typedef struct vring_used vring_used_t;
+
+// Device-readable header of each request.
+struct virtio_blk_header {
+  uint32 type;
+  uint32 reserved;
+  uint64 sector;
+} __attribute__((packed));
+typedef struct virtio_blk_header virtio_blk_header_t;
+
+struct virtio_fragment {
+  uint32 phy_addr;
+  uint32 length;
+};
+typedef struct virtio_fragment virtio_fragment_t;
+
+struct virtqueue {
+  uint16 size;
+  vring_desc_t* desc;
+  vring_avail_t* avail;
+  vring_used_t* used;
+  // free descriptors are chained by next
+  uint16 free_head;
+  uint16 num_free;
+  // avail idx not yet published to device
+  uint16 avail_idx;
+  uint16 last_used;
+  // in-flight request of each chain, indexed by head descriptor
+  block_request_t** requests;
+  // header and status byte of each chain, indexed by head descriptor
+  virtio_blk_header_t* headers;
+  uint32 headers_phy;
+  volatile uint8* statuses;
+  uint32 statuses_phy;
+};
+typedef struct virtqueue virtqueue_t;
+
+static uint16 io_base;
+static bool flush_supported = false;
+static virtqueue_t vq;
+// Protects vq. Taken with irq saved, as completion runs in interrupt context.
+static spinlock_t vq_lock;
+// Waiters for request completion, or for free descriptors.
+static wait_queue_t vq_wait;
+
+static block_device_t virtio_blk_device;
+
+// Keep compiler from reordering ring memory accesses. x86 does not reorder stores with
+// other stores, and the device is emulated on the same memory model.
+static void ring_barrier() {
+  asm volatile("" : : : "memory");
+}
+
+static uint32 align_up(uint32 value, uint32 align) {
+  return (value + align - 1) / align * align;
+}
+
+static uint32 vring_size(uint16 size) {
+  uint32 desc_avail = size * sizeof(vring_desc_t) + sizeof(uint16) * (3 + size);
+  uint32 used = sizeof(uint16) * 3 + size * sizeof(vring_used_elem_t);
+  return align_up(desc_avail, VRING_ALIGN) + align_up(used, VRING_ALIGN);
+}
+
+// Free the descriptor chain starting at head. vq_lock must be held.
+static void free_chain(uint16 head) {
+  uint16 index = head;
+  uint16 num = 1;
+  while (vq.desc[index].flags & VRING_DESC_F_NEXT) {
+    index = vq.desc[index].next;
+    num++;
+  }
+  vq.desc[index].next = vq.free_head;
+  vq.free_head = head;
+  vq.num_free += num;
+}
+
+// Complete requests from used ring. vq_lock must be held. Returns number of completions.
+static uint32 process_used() {
+  uint32 completed = 0;
+  while (vq.last_used != vq.used->idx) {
+    ring_barrier();
+    vring_used_elem_t* elem = &vq.used->ring[vq.last_used % vq.size];
+    uint16 head = elem->id;
+    block_request_t* request = vq.requests[head];
+    vq.requests[head] = nullptr;
+    request->result = (vq.statuses[head] == VIRTIO_BLK_S_OK) ? 0 : -1;
+    free_chain(head);
+    ring_barrier();
+    request->done = true;
+    vq.last_used++;
+    completed++;
+  }
+  return completed;
+}
+
+static void virtio_blk_interrupt_handler(isr_params_t params) {
+  // Reading ISR status also acknowledges the interrupt.
+  uint8 isr = inb(io_base + VIRTIO_REG_ISR_STATUS);
+  if (!(isr & VIRTIO_ISR_QUEUE)) {
+    return;
+  }
+  spinlock_lock_irqsave(&vq_lock);
+  uint32 completed = process_used();
+  spinlock_unlock_irqrestore(&vq_lock);
+  if (completed > 0) {
+    wake_up_all(&vq_wait);
+  }
+}
+
+// Poll used ring, before multitasking starts.
+static void poll_used() {
+  spinlock_lock_irqsave(&vq_lock);
+  process_used();
+  spinlock_unlock_irqrestore(&vq_lock);
+}
+
+// Translate request data to physical fragments, merging physically contiguous pages.
+// Returns the number of fragments, or -1.
+static int32 build_fragments(block_request_t* request, virtio_fragment_t* fragments) {
+  uint32 num = 0;
+  for (uint32 i = 0; i < request->segments_num; i++) {
+    char* addr = request->segments[i].buffer;
+    uint32 left = request->segments[i].sectors * BLOCK_SECTOR_SIZE;
+    while (left > 0) {
+      uint32 length = min(left, PAGE_SIZE - (uint32)addr % PAGE_SIZE);
+      int32 phy = dma_buffer_phy(addr, !request->write);
+      if (phy < 0) {
+        return -1;
+      }
+      if (num > 0 && fragments[num - 1].phy_addr + fragments[num - 1].length == (uint32)phy) {
+        fragments[num - 1].length += length;
+      } else {
+        if (num == VIRTIO_BLK_FRAGMENTS_MAX) {
+          return -1;
+        }
+        fragments[num].phy_addr = phy;
+        fragments[num].length = length;
+        num++;
+      }
+      addr += length;
+      left -= length;
+    }
+  }
+  return num;
+}
+
+// Put a request chain on the avail ring: header, data fragments, status. It's visible to
+// device after kick. vq_lock must be held. Returns false if descriptors are not enough.
+static bool post_request(block_request_t* request, virtio_fragment_t* fragments, uint32 num) {
+  if (vq.num_free < num + 2) {
+    return false;
+  }
+  uint16 head = vq.free_head;
+  virtio_blk_header_t* header = &vq.headers[head];
+  if (request->flush) {
+    header->type = VIRTIO_BLK_T_FLUSH;
+    header->sector = 0;
+  } else {
+    header->type = request->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    header->sector = request->lba;
+  }
+  header->reserved = 0;
+  vq.statuses[head] = 0xFF;
+
+  uint16 index = head;
+  vq.desc[index].addr = vq.headers_phy + head * sizeof(virtio_blk_header_t);
+  vq.desc[index].len = sizeof(virtio_blk_header_t);
+  vq.desc[index].flags = VRING_DESC_F_NEXT;
+  for (uint32 i = 0; i < num; i++) {
+    index = vq.desc[index].next;
+    vq.desc[index].addr = fragments[i].phy_addr;
+    vq.desc[index].len = fragments[i].length;
+    vq.desc[index].flags = VRING_DESC_F_NEXT | (request->write ? 0 : VRING_DESC_F_WRITE);
+  }
+  index = vq.desc[index].next;
+  vq.desc[index].addr = vq.statuses_phy + head;
+  vq.desc[index].len = 1;
+  vq.desc[index].flags = VRING_DESC_F_WRITE;
+
+  vq.free_head = vq.desc[index].next;
+  vq.num_free -= num + 2;
+  vq.requests[head] = request;
+  vq.avail->ring[vq.avail_idx % vq.size] = head;
+  vq.avail_idx++;
+  return true;
+}
+
+// Publish posted chains and notify device. vq_lock must be held.
+static void kick() {
+  if (vq.avail->idx == vq.avail_idx) {
+    return;
+  }
+  ring_barrier();
+  vq.avail->idx = vq.avail_idx;
+  ring_barrier();
+  if (!(vq.used->flags & VRING_USED_F_NO_NOTIFY)) {
+    outw(io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+  }
+}
+
+static bool descs_available(void* arg) {
+  return vq.num_free >= (uint32)arg;
+}
+
+static bool request_is_done(void* arg) {
+  return ((block_request_t*)arg)->done;
+}
+
+static void virtio_blk_submit(block_device_t* dev, block_request_t** requests, uint32 num) {
+  virtio_fragment_t fragments[VIRTIO_BLK_FRAGMENTS_MAX];
+  for (uint32 i = 0; i < num; i++) {
+    block_request_t* request = requests[i];
+    request->done = false;
+    // Touching buffer pages may fault, so translate before taking vq_lock. Flush carries
+    // no data, just header and status.
+    int32 fragments_num = request->flush ? 0 : build_fragments(request, fragments);
+    if (fragments_num < 0 || (fragments_num == 0 && !request->flush)) {
+      request->result = -1;
+      request->done = true;
+      continue;
+    }
+
+    spinlock_lock_irqsave(&vq_lock);
+    while (!post_request(request, fragments, fragments_num)) {
+      // Ring is full. Let device run what is queued, and wait for completions.
+      kick();
+      spinlock_unlock_irqrestore(&vq_lock);
+      if (multi_task_is_enabled()) {
+        wait_event(&vq_wait, descs_available, (void*)(fragments_num + 2));
+      } else {
+        poll_used();
+      }
+      spinlock_lock_irqsave(&vq_lock);
+    }
+    spinlock_unlock_irqrestore(&vq_lock);
+  }
+
+  spinlock_lock_irqsave(&vq_lock);
+  kick();
+  spinlock_unlock_irqrestore(&vq_lock);
+}
+
+static void virtio_blk_wait(block_device_t* dev, block_request_t* request) {
+  if (multi_task_is_enabled() && !is_in_irq_context()) {
+    wait_event(&vq_wait, request_is_done, request);
+    return;
+  }
+  while (!request->done) {
+    poll_used();
+  }
+}
+
+static int32 virtio_blk_transfer(
+    uint32 lba, block_segment_t* segments, uint32 segments_num, bool write) {
+  block_request_t request;
+  request.lba = lba;
+  request.segments = segments;
+  request.segments_num = segments_num;
+  request.write = write;
+  request.flush = false;
+  block_request_t* requests[1] = {&request};
+  virtio_blk_submit(&virtio_blk_device, requests, 1);
+  virtio_blk_wait(&virtio_blk_device, &request);
+  if (request.result != 0) {
+    monitor_printf("virtio-blk: %s error on lba %u\n", write ? "write" : "read", lba);
+  }
+  return request.result;
+}
+
+static int32 virtio_blk_read(
+    block_device_t* dev, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return virtio_blk_transfer(lba, segments, segments_num, false);
+}
+
+static int32 virtio_blk_write(
+    block_device_t* dev, uint32 lba, block_segment_t* segments, uint32 segments_num) {
+  return virtio_blk_transfer(lba, segments, segments_num, true);
+}
+
+// Without VIRTIO_BLK_F_FLUSH the device has no volatile cache, so completed writes are
+// already durable.
+static int32 virtio_blk_flush(block_device_t* dev) {
+  if (!flush_supported) {
+    return 0;
+  }
+  block_request_t request;
+  memset(&request, 0, sizeof(block_request_t));
+  request.flush = true;
+  block_request_t* requests[1] = {&request};
+  virtio_blk_submit(dev, requests, 1);
+  virtio_blk_wait(dev, &request);
+  if (request.result != 0) {
+    monitor_printf("virtio-blk: flush error\n");
+  }
+  return request.result;
+}
+
+static block_device_t virtio_blk_device = {
+  .name = "virtio-blk0",
+  .max_sectors = VIRTIO_BLK_SECTORS_MAX,
+  .read = virtio_blk_read,
+  .write = virtio_blk_write,
+  .flush = virtio_blk_flush,
+  .submit = virtio_blk_submit,
+  .wait = virtio_blk_wait,
+};
+
+static bool init_virtqueue() {
+  outw(io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+  uint16 size = inw(io_base + VIRTIO_REG_QUEUE_SIZE);
+  if (size == 0) {
+    return false;
+  }
+
+  // Legacy device requires the whole ring physically contiguous and page aligned.
+  uint32 ring_phy;
+  char* ring = (char*)dma_alloc_pages(vring_size(size) / PAGE_SIZE, &ring_phy);
+  uint32 headers_size = size * sizeof(virtio_blk_header_t);
+  uint32 extra_pages = align_up(headers_size + size, PAGE_SIZE) / PAGE_SIZE;
+  uint32 extra_phy;
+  char* extra = (char*)dma_alloc_pages(extra_pages, &extra_phy);
+  if (ring == nullptr || extra == nullptr) {
+    return false;
+  }
+
+  vq.size = size;
+  vq.desc = (vring_desc_t*)ring;
+  vq.avail = (vring_avail_t*)(ring + size * sizeof(vring_desc_t));
+  vq.used = (vring_used_t*)(ring + align_up(
+      size * sizeof(vring_desc_t) + sizeof(uint16) * (3 + size), VRING_ALIGN));
+  for (uint32 i = 0; i < size; i++) {
+    vq.desc[i].next = i + 1;
+  }
+  vq.free_head = 0;
+  vq.num_free = size;
+  vq.avail_idx = 0;
+  vq.last_used = 0;
+  vq.requests = (block_request_t**)kmalloc(size * sizeof(block_request_t*));
+  memset(vq.requests, 0, size * sizeof(block_request_t*));
+  vq.headers = (virtio_blk_header_t*)extra;
+  vq.headers_phy = extra_phy;
+  vq.statuses = (uint8*)(extra + headers_size);
+  vq.statuses_phy = extra_phy + headers_size;
+
+  outl(io_base + VIRTIO_REG_QUEUE_PFN, ring_phy / PAGE_SIZE);
+  return true;
+}
+
+block_device_t* init_virtio_blk() {
+  pci_device_t pci;
+  if (!pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, &pci)) {
+    return nullptr;
+  }
+  uint32 bar0 = pci_config_read(&pci, PCI_CONFIG_BAR0);
+  if (!(bar0 & PCI_BAR_IO)) {
+    return nullptr;
+  }
+  io_base = bar0 & PCI_BAR_IO_MASK;
+  pci_enable_bus_master(&pci);
+
+  spinlock_init(&vq_lock);
+  wait_queue_init(&vq_wait);
+
+  // Reset, and then negotiate flush as the only optional feature.
+  outb(io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+  outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+  outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+  uint32 features = inl(io_base + VIRTIO_REG_DEVICE_FEATURES) & VIRTIO_BLK_F_FLUSH;
+  outl(io_base + VIRTIO_REG_GUEST_FEATURES, features);
+  flush_supported = (features != 0);
+
+  if (!init_virtqueue()) {
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+    monitor_printf("virtio-blk: failed to set up virtqueue\n");
+    return nullptr;
+  }
+
+  uint8 irq = pci_config_read(&pci, PCI_CONFIG_INTERRUPT) & 0xFF;
+  register_interrupt_handler(IRQ0_INT_NUM + irq, &virtio_blk_interrupt_handler);
+
+  outb(io_base + VIRTIO_REG_DEVICE_STATUS,
+       VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+  virtio_blk_device.sectors = inl(io_base + VIRTIO_REG_BLK_CAPACITY);
+  return &virtio_blk_device;
+}
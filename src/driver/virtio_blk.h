@@ -0,0 +1,24 @@
+#ifndef DRIVER_VIRTIO_BLK_H
+#define DRIVER_VIRTIO_BLK_H
+
+#include "common/common.h"
+#include "driver/block_device.h"
+
+// Legacy virtio-blk PCI device, as emulated by QEMU with "-drive if=virtio". It has one split
+// virtqueue, and requests stay in flight concurrently until the device completes them by
+// interrupt.
+
+#define VIRTIO_VENDOR_ID           0x1AF4
+#define VIRTIO_BLK_DEVICE_ID       0x1001
+
+// max sectors of one request
+#define VIRTIO_BLK_SECTORS_MAX     256
+// max physical fragments of one request's data
+#define VIRTIO_BLK_FRAGMENTS_MAX   64
+
+
+// ****************************************************************************
+// Returns block device, or nullptr if no virtio-blk device is found.
+block_device_t* init_virtio_blk();
+
+#endif
@@ -0,0 +1,553 @@
+#include "common/stdlib.h"
+#include "driver/hard_disk.h"
+#include "fs/block_cache.h"
+#include "interrupt/timer.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+#include "monitor/monitor.h"
+#include "sync/yieldlock.h"
+#include "sync/wait_queue.h"
+#include "task/scheduler.h"
+#include "utils/hash_table.h"
+#include "utils/math.h"
+
+static block_cache_entry_t entries[BLOCK_CACHE_BLOCKS_NUM];
+// block number -> entry, for entries which are not BLOCK_INVALID
+static hash_table_t blocks_map;
+// unreferenced entries, least recently used first
+static linked_list_t lru_list;
+static yieldlock_t cache_lock;
+// Waiters for a BLOCK_LOADING entry to be loaded.
+static wait_queue_t load_wait;
+// Waiters for an entry to be released to lru list.
+static wait_queue_t lru_wait;
+
+static block_cache_stats_t stats;
+
+// Sequential access detection, over the whole disk.
+static uint32 last_read_block;
+static uint32 sequential_reads;
+// first block not yet read ahead
+static uint32 readahead_next;
+
+struct readahead_range {
+  uint32 block;
+  uint32 num;
+};
+typedef struct readahead_range readahead_range_t;
+
+static readahead_range_t readahead_queue[BLOCK_CACHE_READAHEAD_QUEUE];
+static uint32 readahead_head;
+static uint32 readahead_tail;
+static wait_queue_t readahead_wait;
+static bool readahead_thread_started = false;
+
+// get_blocks flags
+#define GET_READAHEAD  (1 << 0)  // loaded by read-ahead, not a real access
+#define GET_OVERWRITE  (1 << 1)  // caller overwrites whole blocks, so skip loading them
+
+static uint32 dirty_num;
+// set when an allocation found nothing but dirty blocks
+static volatile bool flush_requested;
+static wait_queue_t flush_wait;
+static bool flush_thread_started = false;
+// Serializes write back, which uses the static arrays below.
+static yieldlock_t flush_lock;
+static block_cache_entry_t* flush_entries[BLOCK_CACHE_BLOCKS_NUM];
+static bio_t flush_bios[BLOCK_CACHE_BLOCKS_NUM];
+
+void init_block_cache() {
+  char* buffers = (char*)kmalloc_aligned(BLOCK_CACHE_BLOCKS_NUM * BLOCK_CACHE_BLOCK_SIZE);
+  linked_list_init(&lru_list);
+  for (uint32 i = 0; i < BLOCK_CACHE_BLOCKS_NUM; i++) {
+    block_cache_entry_t* entry = &entries[i];
+    entry->block = 0;
+    entry->data = buffers + i * BLOCK_CACHE_BLOCK_SIZE;
+    entry->state = BLOCK_INVALID;
+    entry->ref_count = 0;
+    entry->readahead = false;
+    entry->dirty = false;
+    entry->lru_node.ptr = entry;
+    linked_list_append(&lru_list, &entry->lru_node);
+  }
+  hash_table_init(&blocks_map);
+  yieldlock_init(&cache_lock);
+  wait_queue_init(&load_wait);
+  wait_queue_init(&lru_wait);
+  wait_queue_init(&readahead_wait);
+  wait_queue_init(&flush_wait);
+  yieldlock_init(&flush_lock);
+  dirty_num = 0;
+  flush_requested = false;
+  memset(&stats, 0, sizeof(block_cache_stats_t));
+  last_read_block = 0;
+  sequential_reads = 0;
+  readahead_next = 0;
+  readahead_head = 0;
+  readahead_tail = 0;
+}
+
+// Find entry of block, or recycle the least recently used clean entry for it, which the
+// caller must then load. Returns with a reference held, or nullptr if all entries are in use
+// or dirty. cache_lock must be held.
+static block_cache_entry_t* lookup_block(uint32 block, bool* created) {
+  block_cache_entry_t* entry = (block_cache_entry_t*)hash_table_get(&blocks_map, block);
+  if (entry != nullptr) {
+    if (entry->ref_count == 0) {
+      linked_list_remove(&lru_list, &entry->lru_node);
+    }
+    entry->ref_count++;
+    *created = false;
+    return entry;
+  }
+
+  linked_list_node_t* node = lru_list.head;
+  while (node != nullptr && ((block_cache_entry_t*)node->ptr)->dirty) {
+    node = node->next;
+  }
+  if (node == nullptr) {
+    return nullptr;
+  }
+  entry = (block_cache_entry_t*)node->ptr;
+  linked_list_remove(&lru_list, &entry->lru_node);
+  if (entry->state != BLOCK_INVALID) {
+    hash_table_remove(&blocks_map, entry->block);
+    stats.evictions++;
+    if (entry->readahead) {
+      stats.readahead_wasted++;
+    }
+  }
+  entry->block = block;
+  entry->state = BLOCK_LOADING;
+  entry->readahead = false;
+  entry->ref_count = 1;
+  hash_table_put(&blocks_map, block, entry);
+  *created = true;
+  return entry;
+}
+
+// cache_lock must be held.
+static void release_block(block_cache_entry_t* entry) {
+  entry->ref_count--;
+  if (entry->ref_count > 0) {
+    return;
+  }
+  if (entry->state == BLOCK_ERROR) {
+    // Drop it, and put it first to be recycled.
+    hash_table_remove(&blocks_map, entry->block);
+    entry->state = BLOCK_INVALID;
+    linked_list_insert_to_head(&lru_list, &entry->lru_node);
+  } else {
+    linked_list_append(&lru_list, &entry->lru_node);
+  }
+}
+
+// Load BLOCK_LOADING entries from disk. One bio is submitted for each block, and the
+// block queue merges consecutive ones, also with other threads' bios.
+static void load_blocks(block_cache_entry_t** loads, uint32 num) {
+  if (num == 0) {
+    return;
+  }
+  block_queue_t* queue = get_hard_disk_queue();
+  bio_t bios[BLOCK_CACHE_BATCH_MAX];
+  for (uint32 i = 0; i < num; i++) {
+    bio_t* bio = &bios[i];
+    bio->lba = loads[i]->block * BLOCK_CACHE_BLOCK_SECTORS;
+    bio->sectors = BLOCK_CACHE_BLOCK_SECTORS;
+    bio->buffer = loads[i]->data;
+    bio->write = false;
+    bio->end_io = nullptr;
+    submit_bio(queue, bio);
+  }
+  for (uint32 i = 0; i < num; i++) {
+    bio_wait(queue, &bios[i]);
+  }
+
+  yieldlock_lock(&cache_lock);
+  for (uint32 i = 0; i < num; i++) {
+    loads[i]->state = (bios[i].result == 0) ? BLOCK_VALID : BLOCK_ERROR;
+  }
+  yieldlock_unlock(&cache_lock);
+  wake_up_all(&load_wait);
+}
+
+// Get referenced entries of blocks [block, block + num), and load the missing ones. Returns
+// number of entries got, which may be less than num if cache is short of free entries.
+static uint32 get_blocks(
+    uint32 block, uint32 num, block_cache_entry_t** got, uint32 flags) {
+  bool readahead = (flags & GET_READAHEAD);
+  block_cache_entry_t* loads[BLOCK_CACHE_BATCH_MAX];
+  // created entries left for caller to fill
+  bool overwrites[BLOCK_CACHE_BATCH_MAX];
+  uint32 loads_num = 0;
+  uint32 got_num = 0;
+
+  yieldlock_lock(&cache_lock);
+  while (got_num < num) {
+    bool created;
+    block_cache_entry_t* entry = lookup_block(block + got_num, &created);
+    if (entry == nullptr) {
+      if (got_num > 0 || readahead) {
+        break;
+      }
+      if (dirty_num > 0) {
+        flush_requested = true;
+        wake_up_one(&flush_wait);
+      }
+      wait_queue_sleep(&lru_wait, &cache_lock);
+      continue;
+    }
+    if (created) {
+      entry->readahead = readahead;
+      // An overwritten block stays BLOCK_LOADING until caller fills it.
+      if (!(flags & GET_OVERWRITE)) {
+        loads[loads_num++] = entry;
+      }
+      if (!readahead) {
+        stats.misses++;
+      }
+    } else if (!readahead) {
+      stats.hits++;
+      if (entry->readahead) {
+        entry->readahead = false;
+        stats.readahead_hits++;
+      }
+    }
+    overwrites[got_num] = created && (flags & GET_OVERWRITE);
+    got[got_num++] = entry;
+  }
+  if (readahead) {
+    stats.readahead_blocks += loads_num;
+  }
+  yieldlock_unlock(&cache_lock);
+
+  load_blocks(loads, loads_num);
+
+  // Wait for blocks being loaded by others.
+  yieldlock_lock(&cache_lock);
+  for (uint32 i = 0; i < got_num; i++) {
+    while (!overwrites[i] && got[i]->state == BLOCK_LOADING) {
+      wait_queue_sleep(&load_wait, &cache_lock);
+    }
+  }
+  yieldlock_unlock(&cache_lock);
+  return got_num;
+}
+
+static void put_blocks(block_cache_entry_t** got, uint32 num) {
+  yieldlock_lock(&cache_lock);
+  for (uint32 i = 0; i < num; i++) {
+    release_block(got[i]);
+  }
+  yieldlock_unlock(&cache_lock);
+  wake_up_all(&lru_wait);
+}
+
+static bool has_readahead(void* arg) {
+  return readahead_head != readahead_tail;
+}
+
+static void readahead_thread() {
+  while (true) {
+    wait_event(&readahead_wait, has_readahead, nullptr);
+    yieldlock_lock(&cache_lock);
+    readahead_range_t range = readahead_queue[readahead_head % BLOCK_CACHE_READAHEAD_QUEUE];
+    readahead_head++;
+    yieldlock_unlock(&cache_lock);
+
+    block_cache_entry_t* got[BLOCK_CACHE_BATCH_MAX];
+    while (range.num > 0) {
+      uint32 num = get_blocks(
+          range.block, min(range.num, BLOCK_CACHE_BATCH_MAX), got, GET_READAHEAD);
+      if (num == 0) {
+        break;
+      }
+      put_blocks(got, num);
+      range.block += num;
+      range.num -= num;
+    }
+  }
+}
+
+// Detect sequential reads, and queue read-ahead when the reader gets close to the end of
+// the read-ahead window.
+static void check_readahead(uint32 first, uint32 last) {
+  if (!multi_task_is_enabled()) {
+    return;
+  }
+
+  yieldlock_lock(&cache_lock);
+  if (first == last_read_block || first == last_read_block + 1) {
+    sequential_reads++;
+  } else {
+    sequential_reads = 0;
+    readahead_next = 0;
+  }
+  last_read_block = last;
+
+  bool queued = false;
+  uint32 disk_blocks = get_hard_disk()->sectors / BLOCK_CACHE_BLOCK_SECTORS;
+  if (sequential_reads >= BLOCK_CACHE_SEQ_TRIGGER && last + 1 < disk_blocks &&
+      readahead_next <= last + BLOCK_CACHE_READAHEAD / 2 &&
+      readahead_tail - readahead_head < BLOCK_CACHE_READAHEAD_QUEUE) {
+    uint32 start = max(readahead_next, last + 1);
+    uint32 end = min(last + 1 + BLOCK_CACHE_READAHEAD, disk_blocks);
+    readahead_range_t* range = &readahead_queue[readahead_tail % BLOCK_CACHE_READAHEAD_QUEUE];
+    range->block = start;
+    range->num = end - start;
+    readahead_tail++;
+    readahead_next = end;
+    queued = true;
+  }
+  bool start_thread = queued && !readahead_thread_started;
+  readahead_thread_started = readahead_thread_started || queued;
+  yieldlock_unlock(&cache_lock);
+
+  if (start_thread) {
+    start_kernel_thread("block readahead", readahead_thread);
+  }
+  if (queued) {
+    wake_up_one(&readahead_wait);
+  }
+}
+
+int32 block_cache_read(char* buffer, uint32 start, uint32 length) {
+  if (length == 0) {
+    return 0;
+  }
+  uint32 end = start + length;
+  uint32 first = start / BLOCK_CACHE_BLOCK_SIZE;
+  uint32 last = (end - 1) / BLOCK_CACHE_BLOCK_SIZE;
+
+  int32 ret = 0;
+  block_cache_entry_t* got[BLOCK_CACHE_BATCH_MAX];
+  uint32 crt = start;
+  for (uint32 block = first; block <= last && ret == 0;) {
+    uint32 num = get_blocks(block, min(last + 1 - block, BLOCK_CACHE_BATCH_MAX), got, 0);
+    for (uint32 i = 0; i < num; i++) {
+      if (got[i]->state != BLOCK_VALID) {
+        ret = -1;
+        break;
+      }
+      uint32 block_end = (block + i + 1) * BLOCK_CACHE_BLOCK_SIZE;
+      uint32 copy_end = min(block_end, end);
+      memcpy(buffer, got[i]->data + crt % BLOCK_CACHE_BLOCK_SIZE, copy_end - crt);
+      buffer += copy_end - crt;
+      crt = copy_end;
+    }
+    put_blocks(got, num);
+    block += num;
+  }
+
+  check_readahead(first, last);
+  return ret;
+}
+
+int32 block_cache_read_direct(char* buffer, uint32 start, uint32 length) {
+  if (length == 0) {
+    return 0;
+  }
+  if ((uint32)buffer < KERNEL_VADDR_START) {
+    return block_cache_read(buffer, start, length);
+  }
+  uint32 first = start / BLOCK_CACHE_BLOCK_SIZE;
+  uint32 last = (start + length - 1) / BLOCK_CACHE_BLOCK_SIZE;
+  yieldlock_lock(&cache_lock);
+  bool cached = false;
+  for (uint32 block = first; block <= last && !cached; block++) {
+    cached = hash_table_contains(&blocks_map, block);
+  }
+  if (!cached) {
+    stats.direct_reads++;
+  }
+  yieldlock_unlock(&cache_lock);
+
+  if (cached) {
+    return block_cache_read(buffer, start, length);
+  }
+  return read_hard_disk(buffer, start, length);
+}
+
+// Write back all dirty blocks. They are pinned and marked clean first, so writers may dirty
+// them again meanwhile, and then the next flush writes them again. Bios are submitted in
+// block order all together, for the block queue to merge. Blocks which fail to write are
+// marked dirty again, so their data is kept and retried by the next flush.
+static int32 flush_dirty() {
+  yieldlock_lock(&flush_lock);
+  yieldlock_lock(&cache_lock);
+  uint32 num = 0;
+  for (uint32 i = 0; i < BLOCK_CACHE_BLOCKS_NUM; i++) {
+    block_cache_entry_t* entry = &entries[i];
+    if (!entry->dirty) {
+      continue;
+    }
+    if (entry->ref_count == 0) {
+      linked_list_remove(&lru_list, &entry->lru_node);
+    }
+    entry->ref_count++;
+    entry->dirty = false;
+
+    // insertion sort by block
+    uint32 j = num++;
+    while (j > 0 && flush_entries[j - 1]->block > entry->block) {
+      flush_entries[j] = flush_entries[j - 1];
+      j--;
+    }
+    flush_entries[j] = entry;
+  }
+  dirty_num = 0;
+  flush_requested = false;
+  yieldlock_unlock(&cache_lock);
+
+  block_queue_t* queue = get_hard_disk_queue();
+  for (uint32 i = 0; i < num; i++) {
+    bio_t* bio = &flush_bios[i];
+    bio->lba = flush_entries[i]->block * BLOCK_CACHE_BLOCK_SECTORS;
+    bio->sectors = BLOCK_CACHE_BLOCK_SECTORS;
+    bio->buffer = flush_entries[i]->data;
+    bio->write = true;
+    bio->end_io = nullptr;
+    submit_bio(queue, bio);
+  }
+  for (uint32 i = 0; i < num; i++) {
+    bio_wait(queue, &flush_bios[i]);
+  }
+
+  uint32 errors = 0;
+  yieldlock_lock(&cache_lock);
+  for (uint32 i = 0; i < num; i++) {
+    block_cache_entry_t* entry = flush_entries[i];
+    if (flush_bios[i].result != 0) {
+      errors++;
+      if (!entry->dirty) {
+        entry->dirty = true;
+        dirty_num++;
+      }
+    }
+  }
+  stats.writebacks += num;
+  stats.write_errors += errors;
+  yieldlock_unlock(&cache_lock);
+  put_blocks(flush_entries, num);
+  yieldlock_unlock(&flush_lock);
+  return errors > 0 ? -1 : 0;
+}
+
+static bool flush_needed(void* arg) {
+  return dirty_num >= BLOCK_CACHE_DIRTY_THRESHOLD || flush_requested;
+}
+
+// Write back dirty blocks when there are enough of them, or cache runs short of clean
+// blocks, or at latest every BLOCK_CACHE_FLUSH_INTERVAL_MS.
+static void flush_thread() {
+  while (true) {
+    wait_event_timeout(&flush_wait, flush_needed, nullptr, BLOCK_CACHE_FLUSH_INTERVAL_MS);
+    if (dirty_num > 0 && flush_dirty() != 0) {
+      // Failed blocks are dirty again, back off instead of retrying them right away.
+      timer_sleep_ms(BLOCK_CACHE_FLUSH_INTERVAL_MS);
+    }
+  }
+}
+
+// Fill the got blocks from buffer and mark them dirty. Blocks got with GET_OVERWRITE are
+// valid after this.
+static void fill_blocks(
+    block_cache_entry_t** got, uint32 num, char** buffer, uint32* crt, uint32 end) {
+  for (uint32 i = 0; i < num; i++) {
+    uint32 block_end = (got[i]->block + 1) * BLOCK_CACHE_BLOCK_SIZE;
+    uint32 copy_end = min(block_end, end);
+    memcpy(got[i]->data + *crt % BLOCK_CACHE_BLOCK_SIZE, *buffer, copy_end - *crt);
+    *buffer += copy_end - *crt;
+    *crt = copy_end;
+  }
+
+  yieldlock_lock(&cache_lock);
+  for (uint32 i = 0; i < num; i++) {
+    got[i]->state = BLOCK_VALID;
+    if (!got[i]->dirty) {
+      got[i]->dirty = true;
+      dirty_num++;
+    }
+  }
+  stats.writes += num;
+  yieldlock_unlock(&cache_lock);
+  wake_up_all(&load_wait);
+}
+
+int32 block_cache_write(char* buffer, uint32 start, uint32 length) {
+  if (length == 0) {
+    return 0;
+  }
+  uint32 end = start + length;
+  uint32 first = start / BLOCK_CACHE_BLOCK_SIZE;
+  uint32 last = (end - 1) / BLOCK_CACHE_BLOCK_SIZE;
+
+  int32 ret = 0;
+  block_cache_entry_t* got[BLOCK_CACHE_BATCH_MAX];
+  uint32 crt = start;
+  for (uint32 block = first; block <= last && ret == 0;) {
+    // Partially written head and tail blocks are read first, whole blocks are not.
+    uint32 block_start = block * BLOCK_CACHE_BLOCK_SIZE;
+    bool partial = (crt > block_start) || (end < block_start + BLOCK_CACHE_BLOCK_SIZE);
+    uint32 num;
+    if (partial) {
+      num = get_blocks(block, 1, got, 0);
+      if (got[0]->state != BLOCK_VALID) {
+        ret = -1;
+      }
+    } else {
+      uint32 whole_end = (end % BLOCK_CACHE_BLOCK_SIZE == 0) ? last + 1 : last;
+      num = get_blocks(
+          block, min(whole_end - block, BLOCK_CACHE_BATCH_MAX), got, GET_OVERWRITE);
+    }
+    if (ret == 0) {
+      fill_blocks(got, num, &buffer, &crt, end);
+    }
+    put_blocks(got, num);
+    block += num;
+  }
+
+  if (!multi_task_is_enabled()) {
+    // No flusher before multitasking, so write through.
+    return flush_dirty() != 0 ? -1 : ret;
+  }
+  yieldlock_lock(&cache_lock);
+  bool start_thread = !flush_thread_started;
+  flush_thread_started = true;
+  bool wake = (dirty_num >= BLOCK_CACHE_DIRTY_THRESHOLD);
+  yieldlock_unlock(&cache_lock);
+  if (start_thread) {
+    start_kernel_thread("block flush", flush_thread);
+  }
+  if (wake) {
+    wake_up_one(&flush_wait);
+  }
+  return ret;
+}
+
+int32 block_cache_sync() {
+  int32 ret = flush_dirty();
+  if (flush_hard_disk() != 0) {
+    ret = -1;
+  }
+  return ret;
+}
+
+void block_cache_get_stats(block_cache_stats_t* result) {
+  yieldlock_lock(&cache_lock);
+  *result = stats;
+  yieldlock_unlock(&cache_lock);
+}
+
+void block_cache_print_stats() {
+  block_cache_stats_t s;
+  block_cache_get_stats(&s);
+  uint32 accesses = s.hits + s.misses;
+  monitor_printf("block cache: hits %u misses %u hit rate %u/100, evictions %u\n",
+                 s.hits, s.misses, accesses > 0 ? s.hits * 100 / accesses : 0, s.evictions);
+  monitor_printf("  readahead: blocks %u hits %u wasted %u\n",
+                 s.readahead_blocks, s.readahead_hits, s.readahead_wasted);
+  monitor_printf("  writes: blocks %u written back %u errors %u\n",
+                 s.writes, s.writebacks, s.write_errors);
+  monitor_printf("  direct reads: %u\n", s.direct_reads);
+}
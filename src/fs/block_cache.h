@@ -0,0 +1,98 @@
+#ifndef FS_BLOCK_CACHE_H
+#define FS_BLOCK_CACHE_H
+
+#include "common/common.h"
+#include "utils/linked_list.h"
+
+// Cache of disk blocks between file systems and hard disk. Blocks are keyed by block number
+// (disk byte offset / BLOCK_CACHE_BLOCK_SIZE), and unreferenced blocks are evicted in LRU
+// order. Sequential reads trigger asynchronous read-ahead of the following blocks.
+//
+// Writes are write-back: they only dirty cached blocks, and a flusher thread writes dirty
+// blocks to disk in block order when there are enough of them or they get old, so that the
+// block queue merges them into large requests. block_cache_sync() makes them durable.
+
+#define BLOCK_CACHE_BLOCK_SIZE     4096
+#define BLOCK_CACHE_BLOCKS_NUM     256
+#define BLOCK_CACHE_BLOCK_SECTORS  (BLOCK_CACHE_BLOCK_SIZE / 512)
+// max blocks looked up and loaded in one batch
+#define BLOCK_CACHE_BATCH_MAX      16
+// blocks read ahead of a sequential reader
+#define BLOCK_CACHE_READAHEAD      16
+// consecutive sequential reads before read-ahead starts
+#define BLOCK_CACHE_SEQ_TRIGGER    2
+// pending read-ahead ranges
+#define BLOCK_CACHE_READAHEAD_QUEUE  8
+// dirty blocks which wake the flusher before its interval
+#define BLOCK_CACHE_DIRTY_THRESHOLD  64
+// max time a block stays dirty before flusher writes it
+#define BLOCK_CACHE_FLUSH_INTERVAL_MS  1000
+
+enum block_state {
+  BLOCK_INVALID,
+  BLOCK_LOADING,
+  BLOCK_VALID,
+  BLOCK_ERROR
+};
+
+struct block_cache_entry {
+  uint32 block;
+  char* data;
+  enum block_state state;
+  uint32 ref_count;
+  // loaded by read-ahead, and not read yet
+  bool readahead;
+  // modified and not written back yet, never recycled while set
+  bool dirty;
+  // in lru list while ref_count is 0
+  linked_list_node_t lru_node;
+};
+typedef struct block_cache_entry block_cache_entry_t;
+
+struct block_cache_stats {
+  uint32 hits;
+  uint32 misses;
+  uint32 evictions;
+  // blocks loaded by read-ahead
+  uint32 readahead_blocks;
+  // read-ahead blocks which were read later
+  uint32 readahead_hits;
+  // read-ahead blocks evicted before being read
+  uint32 readahead_wasted;
+  // blocks written by callers, and blocks written back to disk
+  uint32 writes;
+  uint32 writebacks;
+  uint32 write_errors;
+  // reads which bypassed cache
+  uint32 direct_reads;
+};
+typedef struct block_cache_stats block_cache_stats_t;
+
+
+// ****************************************************************************
+void init_block_cache();
+
+// Read length bytes from disk byte offset start through cache. Returns 0 on success, -1 on
+// disk error.
+int32 block_cache_read(char* buffer, uint32 start, uint32 length);
+
+// Read directly from disk into buffer, bypassing cache, so that a large read neither copies
+// nor evicts cached blocks. Sectors aligned in buffer are transferred without copy. It reads
+// through cache instead if some blocks of the range are cached, which may be newer than disk,
+// or if buffer is in user space, which drivers may touch outside the caller's context.
+int32 block_cache_read_direct(char* buffer, uint32 start, uint32 length);
+
+// Write length bytes to disk byte offset start through cache. Data reaches disk later, by
+// the flusher or block_cache_sync(). Before multitasking it's written through. Returns 0 on
+// success, -1 on disk error.
+int32 block_cache_write(char* buffer, uint32 start, uint32 length);
+
+// Write back all dirty blocks and flush disk write cache. Returns 0 on success, -1 if any
+// write back failed. Blocks which failed stay dirty, including those the flusher failed to
+// write before, so they are retried and reported by every sync until written.
+int32 block_cache_sync();
+
+void block_cache_get_stats(block_cache_stats_t* stats);
+void block_cache_print_stats();
+
+#endif
@@ -3,6 +3,17 @@
 
 #include "common/common.h"
 
+// open flags
+#define O_RDONLY  0
+#define O_WRONLY  1
+#define O_RDWR    2
+#define O_ACCMODE 3
+
+// lseek whence
+#define SEEK_SET  0
+#define SEEK_CUR  1
+#define SEEK_END  2
+
 struct file_stat {
   uint32 size;
   uint8 acl;
@@ -1,27 +1,119 @@
 #include "driver/hard_disk.h"
+#include "fs/block_cache.h"
 #include "fs/naive_fs.h"
 #include "monitor/monitor.h"
 #include "mem/kheap.h"
 #include "common/stdlib.h"
+#include "utils/crc32.h"
 #include "utils/math.h"
 
 fs_t naive_fs;
 uint32 file_num;
 naive_file_meta_t* file_metas;
+// 1 or NAIVE_FS_VERSION
+static uint32 fs_version;
+// v2 metas offset, for updating crc on disk
+static uint32 metas_offset;
+// file data CRC32 has been checked, per file
+static bool* crc_checked;
+
+// Open addressing hash index of file_metas by filename, read from v2 image or built at mount
+// time. file_metas keeps its on-disk order, which list_dir prints in.
+typedef naive_fs_index_slot_t name_slot_t;
+
+static name_slot_t* name_index;
+// power of 2, and larger than file_num
+static uint32 name_index_size;
 
 fs_t* get_naive_fs() {
   return &naive_fs;
 }
 
-static int32 naive_fs_stat_file(char* filename, file_stat_t* stat) {
-  for (int i = 0; i < file_num; i++) {
-    naive_file_meta_t* meta = file_metas + i;
-    if (strcmp(meta->filename, filename) == 0) {
-      stat->size = meta->size;
-      return 0;
+// FNV-1a
+static uint32 filename_hash(char* filename) {
+  uint32 hash = 2166136261u;
+  for (char* c = filename; *c != '\0'; c++) {
+    hash ^= (uint8)*c;
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+// Linear probing from the hash slot, until filename or an empty slot is found.
+static name_slot_t* naive_fs_find_slot(char* filename, uint32 hash) {
+  uint32 mask = name_index_size - 1;
+  for (uint32 i = hash & mask;; i = (i + 1) & mask) {
+    name_slot_t* slot = &name_index[i];
+    if (slot->meta == 0 ||
+        (slot->hash == hash && strcmp(file_metas[slot->meta - 1].filename, filename) == 0)) {
+      return slot;
     }
   }
-  return -1;
+}
+
+// The index from image is used only if a lookup of every file finds it. Each used slot must
+// point to a distinct valid meta, hold the hash of its filename, and be where the probe for
+// that filename stops. Used slots must cover all file_num metas.
+static bool check_name_index() {
+  bool* seen = (bool*)kmalloc(max(file_num, 1) * sizeof(bool));
+  memset(seen, 0, max(file_num, 1) * sizeof(bool));
+  uint32 used = 0;
+  bool valid = true;
+  for (uint32 i = 0; i < name_index_size && valid; i++) {
+    name_slot_t* slot = &name_index[i];
+    if (slot->meta == 0) {
+      continue;
+    }
+    if (slot->meta > file_num || seen[slot->meta - 1]) {
+      valid = false;
+      break;
+    }
+    seen[slot->meta - 1] = true;
+    used++;
+    // The probe passes this slot at latest, so it always ends.
+    char* filename = file_metas[slot->meta - 1].filename;
+    valid = slot->hash == filename_hash(filename) &&
+            naive_fs_find_slot(filename, slot->hash) == slot;
+  }
+  kfree(seen);
+  return valid && used == file_num;
+}
+
+static void build_name_index() {
+  name_index_size = NAIVE_FS_INDEX_MIN;
+  while (name_index_size < file_num * 2) {
+    name_index_size *= 2;
+  }
+  name_index = (name_slot_t*)kmalloc(name_index_size * sizeof(name_slot_t));
+  memset(name_index, 0, name_index_size * sizeof(name_slot_t));
+
+  for (uint32 i = 0; i < file_num; i++) {
+    char* filename = file_metas[i].filename;
+    uint32 hash = filename_hash(filename);
+    name_slot_t* slot = naive_fs_find_slot(filename, hash);
+    // For duplicate names the first one wins, as with a linear scan.
+    if (slot->meta == 0) {
+      slot->hash = hash;
+      slot->meta = i + 1;
+    }
+  }
+}
+
+static naive_file_meta_t* naive_fs_find_meta(char* filename) {
+  name_slot_t* slot = naive_fs_find_slot(filename, filename_hash(filename));
+  if (slot->meta == 0) {
+    return nullptr;
+  }
+  return file_metas + slot->meta - 1;
+}
+
+static int32 naive_fs_stat_file(char* filename, file_stat_t* stat) {
+  naive_file_meta_t* meta = naive_fs_find_meta(filename);
+  if (meta == nullptr) {
+    return -1;
+  }
+  stat->size = meta->size;
+  return 0;
 }
 
 static int32 naive_fs_list_dir(char* dir) {
@@ -49,47 +141,213 @@ static int32 naive_fs_list_dir(char* dir) {
   return -1;
 }
 
-static int32 naive_fs_read_data(char* filename, char* buffer, uint32 start, uint32 length) {
-  naive_file_meta_t* file_meta = nullptr;
-  for (int i = 0; i < file_num; i++) {
-    naive_file_meta_t* meta = file_metas + i;
-    if (strcmp(meta->filename, filename) == 0) {
-      file_meta = meta;
-      break;
-    }
+// Check CRC32 of a whole file read, once per file.
+static bool check_file_crc(naive_file_meta_t* file_meta, char* data) {
+  uint32 index = file_meta - file_metas;
+  if (file_meta->crc == 0 || crc_checked[index]) {
+    return true;
   }
-  if (file_meta == nullptr) {
+  if (crc32(data, file_meta->size) != file_meta->crc) {
+    monitor_printf("naive fs: %s checksum mismatch\n", file_meta->filename);
+    return false;
+  }
+  crc_checked[index] = true;
+  return true;
+}
+
+// Data of file no longer matches its recorded CRC32, clear it on disk.
+static int32 clear_file_crc(naive_file_meta_t* file_meta) {
+  if (file_meta->crc == 0) {
+    return 0;
+  }
+  file_meta->crc = 0;
+  uint32 crc_offset = metas_offset + (file_meta - file_metas) * sizeof(naive_file_meta_t) +
+                      ((char*)&file_meta->crc - (char*)file_meta);
+  return block_cache_write((char*)&file_meta->crc, naive_fs.partition.offset + crc_offset,
+                           sizeof(uint32));
+}
+
+static int32 naive_fs_read_meta(
+    naive_file_meta_t* file_meta, char* buffer, uint32 start, uint32 length) {
+  uint32 offset = file_meta->offset;
+  uint32 size = file_meta->size;
+  if (start >= size) {
+    return 0;
+  }
+  if (length > size - start) {
+    length = size - start;
+  }
+
+  // v2 file data is sector aligned, so a large read into a kernel buffer goes there without
+  // copy. User buffers still read through cache.
+  uint32 disk_start = naive_fs.partition.offset + offset + start;
+  int32 ret;
+  if (fs_version >= 2 && length >= NAIVE_FS_DIRECT_READ_MIN) {
+    ret = block_cache_read_direct(buffer, disk_start, length);
+  } else {
+    ret = block_cache_read(buffer, disk_start, length);
+  }
+  if (ret != 0) {
     return -1;
   }
+  if (start == 0 && length == size && !check_file_crc(file_meta, buffer)) {
+    return -1;
+  }
+  return length;
+}
 
+// Files have fixed extents on disk, so writes are clamped to file size and never grow it.
+static int32 naive_fs_write_meta(
+    naive_file_meta_t* file_meta, char* buffer, uint32 start, uint32 length) {
   uint32 offset = file_meta->offset;
   uint32 size = file_meta->size;
-  if (length > size) {
-    length = size;
+  if (start >= size) {
+    return 0;
+  }
+  if (length > size - start) {
+    length = size - start;
+  }
+
+  if (clear_file_crc(file_meta) != 0 ||
+      block_cache_write(buffer, naive_fs.partition.offset + offset + start, length) != 0) {
+    return -1;
   }
+  return length;
+}
 
-  read_hard_disk((char*)buffer, naive_fs.partition.offset + offset + start, length);
-  return length;  
+static int32 naive_fs_read_data(char* filename, char* buffer, uint32 start, uint32 length) {
+  naive_file_meta_t* file_meta = naive_fs_find_meta(filename);
+  if (file_meta == nullptr) {
+    return -1;
+  }
+  return naive_fs_read_meta(file_meta, buffer, start, length);
 }
 
 static int32 naive_fs_write_data(char* filename, char* buffer, uint32 start, uint32 length) {
+  naive_file_meta_t* file_meta = naive_fs_find_meta(filename);
+  if (file_meta == nullptr) {
+    return -1;
+  }
+  return naive_fs_write_meta(file_meta, buffer, start, length);
+}
+
+static int32 naive_fs_open_file(char* filename, file_t* file) {
+  naive_file_meta_t* file_meta = naive_fs_find_meta(filename);
+  if (file_meta == nullptr) {
+    return -1;
+  }
+  file->inode = file_meta;
+  file->size = file_meta->size;
+  return 0;
+}
+
+static int32 naive_fs_read_inode(file_t* file, char* buffer, uint32 start, uint32 length) {
+  return naive_fs_read_meta((naive_file_meta_t*)file->inode, buffer, start, length);
+}
+
+static int32 naive_fs_write_inode(file_t* file, char* buffer, uint32 start, uint32 length) {
+  return naive_fs_write_meta((naive_file_meta_t*)file->inode, buffer, start, length);
+}
+
+// Mount with no files, when the image can not be read or parsed.
+static void load_empty() {
+  file_num = 0;
+  file_metas = nullptr;
+  build_name_index();
+}
+
+static void load_v1() {
+  fs_version = 1;
+  metas_offset = sizeof(uint32);
+  uint32 meta_size = file_num * sizeof(naive_file_meta_v1_t);
+  naive_file_meta_v1_t* metas_v1 = (naive_file_meta_v1_t*)kmalloc(meta_size);
+  if (block_cache_read((char*)metas_v1, naive_fs.partition.offset + metas_offset,
+                       meta_size) != 0) {
+    monitor_printf("naive fs: failed to read file metas\n");
+    kfree(metas_v1);
+    load_empty();
+    return;
+  }
+
+  file_metas = (naive_file_meta_t*)kmalloc(file_num * sizeof(naive_file_meta_t));
+  for (uint32 i = 0; i < file_num; i++) {
+    memcpy(file_metas[i].filename, metas_v1[i].filename, sizeof(metas_v1[i].filename));
+    file_metas[i].size = metas_v1[i].size;
+    file_metas[i].offset = metas_v1[i].offset;
+    file_metas[i].crc = 0;
+  }
+  kfree(metas_v1);
+  build_name_index();
+}
+
+static void load_v2(naive_fs_superblock_t* superblock) {
+  fs_version = superblock->version;
+  file_num = superblock->file_num;
+  metas_offset = superblock->metas_offset;
+  if ((naive_fs.partition.offset + superblock->data_offset) % NAIVE_FS_DATA_ALIGN != 0) {
+    monitor_printf("naive fs: file data is not aligned on disk\n");
+  }
+  uint32 meta_size = file_num * sizeof(naive_file_meta_t);
+  file_metas = (naive_file_meta_t*)kmalloc(meta_size);
+  if (block_cache_read((char*)file_metas, naive_fs.partition.offset + metas_offset,
+                       meta_size) != 0) {
+    monitor_printf("naive fs: failed to read file metas\n");
+    kfree(file_metas);
+    load_empty();
+    return;
+  }
+  for (uint32 i = 0; i < file_num; i++) {
+    file_metas[i].filename[sizeof(file_metas[i].filename) - 1] = '\0';
+  }
+
+  name_index_size = superblock->index_size;
+  if (name_index_size > file_num && (name_index_size & (name_index_size - 1)) == 0) {
+    uint32 index_bytes = name_index_size * sizeof(name_slot_t);
+    name_index = (name_slot_t*)kmalloc(index_bytes);
+    if (block_cache_read((char*)name_index,
+                         naive_fs.partition.offset + superblock->index_offset,
+                         index_bytes) == 0 && check_name_index()) {
+      return;
+    }
+    kfree(name_index);
+  }
+  monitor_printf("naive fs: filename index unreadable or invalid, rebuilding\n");
+  build_name_index();
 }
 
 void init_naive_fs() {
   naive_fs.type = NAIVE;
-  naive_fs.partition.offset = 2057 * SECTOR_SIZE;
+  naive_fs.partition.offset = HARD_DISK_BOOT_SECTORS * SECTOR_SIZE;
 
   naive_fs.stat_file = naive_fs_stat_file;
   naive_fs.read_data = naive_fs_read_data;
   naive_fs.write_data = naive_fs_write_data;
   naive_fs.list_dir = naive_fs_list_dir;
+  naive_fs.open_file = naive_fs_open_file;
+  naive_fs.read_inode = naive_fs_read_inode;
+  naive_fs.write_inode = naive_fs_write_inode;
 
-  read_hard_disk((char*)&file_num, 0 + naive_fs.partition.offset, sizeof(uint32));
+  naive_fs_superblock_t superblock;
+  if (block_cache_read((char*)&superblock, naive_fs.partition.offset,
+                       sizeof(superblock)) != 0) {
+    monitor_printf("naive fs: failed to read superblock\n");
+    load_empty();
+  } else if (superblock.magic == NAIVE_FS_MAGIC) {
+    if (superblock.version != NAIVE_FS_VERSION) {
+      monitor_printf("naive fs: unsupported version %u\n", superblock.version);
+      load_empty();
+    } else {
+      load_v2(&superblock);
+    }
+  } else {
+    // v1 image starts with file_num
+    file_num = superblock.magic;
+    load_v1();
+  }
   //monitor_printf("naive fs found %d files:\n", file_num);
 
-  uint32 meta_size = file_num * sizeof(naive_file_meta_t);
-  file_metas = (naive_file_meta_t*)kmalloc(meta_size);
-  read_hard_disk((char*)file_metas, 4 + naive_fs.partition.offset, meta_size);
+  crc_checked = (bool*)kmalloc(max(file_num, 1) * sizeof(bool));
+  memset(crc_checked, 0, max(file_num, 1) * sizeof(bool));
   for (int i = 0; i < file_num; i++) {
     naive_file_meta_t* meta = file_metas + i;
     //monitor_printf(" - %s, offset = %d, size = %d\n", meta->filename, meta->offset, meta->size);
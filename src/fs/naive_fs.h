@@ -4,15 +4,61 @@
 #include "common/common.h"
 #include "fs/vfs.h"
 
+// On-disk formats, written by user/disk_image_writer.c. Offsets are bytes from partition
+// start.
+//
+// v1: file_num, then v1 metas, then file data packed back to back.
+// v2: superblock, then metas, then prebuilt filename index, then file data with each file
+//     starting at a NAIVE_FS_DATA_ALIGN boundary of the disk, i.e. of block cache blocks. The
+//     partition itself starts at HARD_DISK_BOOT_SECTORS, which is not aligned.
+#define NAIVE_FS_MAGIC       0x3253464E  // "NFS2"
+#define NAIVE_FS_VERSION     2
+#define NAIVE_FS_DATA_ALIGN  4096
+// min slots of filename hash index
+#define NAIVE_FS_INDEX_MIN   16
+// Reads of v2 files at least this large go directly from disk into caller's buffer.
+#define NAIVE_FS_DIRECT_READ_MIN  (32 * 1024)
+
 fs_t* get_naive_fs();
 
+struct naive_fs_superblock {
+  uint32 magic;
+  uint32 version;
+  uint32 file_num;
+  uint32 metas_offset;
+  uint32 index_offset;
+  // slots of index, a power of 2 larger than file_num
+  uint32 index_size;
+  uint32 data_offset;
+};
+typedef struct naive_fs_superblock naive_fs_superblock_t;
+
+struct naive_file_meta_v1 {
+  char filename[64];
+  uint32 size;
+  uint32 offset;
+};
+typedef struct naive_file_meta_v1 naive_file_meta_v1_t;
+
+// v2 meta, and in-memory meta of both versions.
 struct naive_file_meta {
   char filename[64];
   uint32 size;
   uint32 offset;
+  // CRC32 of file data, 0 if not recorded, e.g. v1 files or files written since
+  uint32 crc;
 };
 typedef struct naive_file_meta naive_file_meta_t;
 
+// Open addressing slot of filename index. A filename is looked up by linear probing from
+// slot FNV-1a(filename) % index_size, until it or an empty slot is found.
+struct naive_fs_index_slot {
+  uint32 hash;
+  // index in metas + 1, 0 if slot is empty
+  uint32 meta;
+};
+typedef struct naive_fs_index_slot naive_fs_index_slot_t;
+
 
 // ****************************************************************************
 void init_naive_fs();
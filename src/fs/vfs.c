@@ -1,5 +1,9 @@
+#include "common/errno.h"
 #include "fs/vfs.h"
 #include "fs/naive_fs.h"
+#include "fs/block_cache.h"
+#include "mem/kheap.h"
+#include "utils/crc32.h"
 
 // ***************************** root fs APIs *********************************
 static fs_t* get_fs(char* path) {
@@ -8,6 +12,8 @@ static fs_t* get_fs(char* path) {
 }
 
 void init_file_system() {
+  init_crc32();
+  init_block_cache();
   init_naive_fs();
 }
 
@@ -30,3 +36,97 @@ int32 write_file(char* filename, char* buffer, uint32 start, uint32 length) {
   fs_t* fs = get_fs(filename);
   return fs->write_data(filename, buffer, start, length);
 }
+
+int32 sync_file_system() {
+  return block_cache_sync();
+}
+
+// ***************************** opened file APIs *****************************
+file_t* open_file(char* filename, uint32 flags) {
+  fs_t* fs = get_fs(filename);
+  file_t* file = (file_t*)kmalloc(sizeof(file_t));
+  file->fs = fs;
+  file->inode = nullptr;
+  file->size = 0;
+  file->offset = 0;
+  file->flags = flags;
+  file->ref_count = 1;
+  yieldlock_init(&file->lock);
+  if (fs->open_file(filename, file) != 0) {
+    kfree(file);
+    return nullptr;
+  }
+  return file;
+}
+
+file_t* dup_file(file_t* file) {
+  yieldlock_lock(&file->lock);
+  file->ref_count++;
+  yieldlock_unlock(&file->lock);
+  return file;
+}
+
+void close_file(file_t* file) {
+  yieldlock_lock(&file->lock);
+  uint32 ref_count = --file->ref_count;
+  yieldlock_unlock(&file->lock);
+  if (ref_count == 0) {
+    kfree(file);
+  }
+}
+
+int32 read_opened_file(file_t* file, char* buffer, uint32 length) {
+  if ((file->flags & O_ACCMODE) == O_WRONLY) {
+    return -EBADF;
+  }
+  yieldlock_lock(&file->lock);
+  int32 ret = 0;
+  if (file->offset < file->size) {
+    ret = file->fs->read_inode(file, buffer, file->offset, length);
+    if (ret > 0) {
+      file->offset += ret;
+    }
+  }
+  yieldlock_unlock(&file->lock);
+  return ret;
+}
+
+int32 write_opened_file(file_t* file, char* buffer, uint32 length) {
+  if ((file->flags & O_ACCMODE) == O_RDONLY) {
+    return -EBADF;
+  }
+  yieldlock_lock(&file->lock);
+  int32 ret = file->fs->write_inode(file, buffer, file->offset, length);
+  if (ret > 0) {
+    file->offset += ret;
+  }
+  yieldlock_unlock(&file->lock);
+  return ret;
+}
+
+int32 seek_file(file_t* file, int32 offset, uint32 whence) {
+  yieldlock_lock(&file->lock);
+  int32 base;
+  if (whence == SEEK_SET) {
+    base = 0;
+  } else if (whence == SEEK_CUR) {
+    base = file->offset;
+  } else if (whence == SEEK_END) {
+    base = file->size;
+  } else {
+    yieldlock_unlock(&file->lock);
+    return -EINVAL;
+  }
+  if (base + offset < 0) {
+    yieldlock_unlock(&file->lock);
+    return -EINVAL;
+  }
+  file->offset = base + offset;
+  yieldlock_unlock(&file->lock);
+  return file->offset;
+}
+
+void stat_opened_file(file_t* file, file_stat_t* stat) {
+  stat->size = file->size;
+  stat->acl = 0;
+}
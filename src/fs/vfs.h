@@ -3,6 +3,7 @@
 
 #include "common/common.h"
 #include "fs/file.h"
+#include "sync/yieldlock.h"
 
 enum fs_type {
   NAIVE,
@@ -14,10 +15,15 @@ struct disk_partition {
 };
 typedef struct disk_partition disk_partition_t;
 
+struct file;
+
 typedef int32 (*stat_file_func)(char* filename, file_stat_t* stat);
 typedef int32 (*list_dir_func)(char* dir);
 typedef int32 (*read_data_func)(char* filename, char* buffer, uint32 start, uint32 length);
 typedef int32 (*write_data_func)(char* filename, char* buffer, uint32 start, uint32 length);
+typedef int32 (*open_file_func)(char* filename, struct file* file);
+typedef int32 (*read_inode_func)(struct file* file, char* buffer, uint32 start, uint32 length);
+typedef int32 (*write_inode_func)(struct file* file, char* buffer, uint32 start, uint32 length);
 
 struct file_system {
   enum fs_type type;
@@ -28,9 +34,28 @@ struct file_system {
   list_dir_func list_dir;
   read_data_func read_data;
   write_data_func write_data;
+  // Resolve filename once into an opened file, which is then read and written without
+  // looking up the name again.
+  open_file_func open_file;
+  read_inode_func read_inode;
+  write_inode_func write_inode;
 };
 typedef struct file_system fs_t;
 
+// An opened file. It's shared by fds dup-ed from the same open, e.g. across fork, so they
+// share the offset too.
+struct file {
+  fs_t* fs;
+  // fs private data of this file, e.g. its meta
+  void* inode;
+  uint32 size;
+  uint32 offset;
+  uint32 flags;
+  uint32 ref_count;
+  yieldlock_t lock;
+};
+typedef struct file file_t;
+
 
 // ****************************************************************************
 void init_file_system();
@@ -39,6 +64,18 @@ int32 stat_file(char* filename, file_stat_t* stat);
 int32 list_dir(char* dir);
 int32 read_file(char* filename, char* buffer, uint32 start, uint32 length);
 int32 write_file(char* filename, char* buffer, uint32 start, uint32 length);
+// Write back cached writes and flush disk. Returns 0 on success, -1 on disk error.
+int32 sync_file_system();
+
+// Opened file APIs. open_file returns nullptr if file is not found.
+file_t* open_file(char* filename, uint32 flags);
+file_t* dup_file(file_t* file);
+void close_file(file_t* file);
+// Read and write at file offset, and advance it.
+int32 read_opened_file(file_t* file, char* buffer, uint32 length);
+int32 write_opened_file(file_t* file, char* buffer, uint32 length);
+int32 seek_file(file_t* file, int32 offset, uint32 whence);
+void stat_opened_file(file_t* file, file_stat_t* stat);
 
 
 #endif
@@ -0,0 +1,115 @@
+#include "common/io.h"
+#include "interrupt/clock.h"
+#include "interrupt/timer.h"
+#include "utils/math.h"
+
+#define PIT_CLOCK  1193180
+// PIT channel 2 counts down for this long to calibrate TSC.
+#define CALIBRATE_MS  10
+
+static bool tsc_enabled = false;
+static uint32 tsc_khz = 0;
+static uint64 tsc_base = 0;
+
+// ns = cycles * tsc_mult >> tsc_shift
+static uint32 tsc_mult = 0;
+static uint32 tsc_shift = 0;
+
+static uint64 rdtsc() {
+  uint32 low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64)high << 32) | low;
+}
+
+static bool cpu_has_tsc() {
+  uint32 eax = 1, ebx, ecx, edx;
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+  return (edx & (1 << 4)) != 0;
+}
+
+// Count TSC cycles while PIT channel 2 counts down CALIBRATE_MS in one-shot mode. Its output
+// is readable in port 0x61 bit 5. Channel 2 is the speaker timer, so it's free to use.
+static uint32 calibrate_tsc_khz() {
+  // gate high, speaker off
+  outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+
+  // channel 2, lobyte/hibyte, mode 0
+  uint32 count = PIT_CLOCK / 1000 * CALIBRATE_MS;
+  outb(0x43, 0xB0);
+  outb(0x42, (uint8)(count & 0xFF));
+  outb(0x42, (uint8)((count >> 8) & 0xFF));
+
+  uint64 start = rdtsc();
+  while ((inb(0x61) & 0x20) == 0) {}
+  uint64 end = rdtsc();
+
+  return (uint32)(end - start) / CALIBRATE_MS;
+}
+
+// Convert cycles to ns with 32-bit multiplies only: split cycles into high and low words.
+static uint64 cycles_to_ns(uint64 cycles) {
+  uint32 high = (uint32)(cycles >> 32);
+  uint32 low = (uint32)cycles;
+  uint64 ns = ((uint64)low * tsc_mult) >> tsc_shift;
+  if (high > 0) {
+    ns += ((uint64)high * tsc_mult) << (32 - tsc_shift);
+  }
+  return ns;
+}
+
+void init_clock() {
+  if (!cpu_has_tsc()) {
+    return;
+  }
+  tsc_khz = calibrate_tsc_khz();
+  if (tsc_khz == 0) {
+    return;
+  }
+
+  // Pick the largest shift (most precision) with mult fitting in 32 bits.
+  uint32 shift = 32;
+  uint64 mult;
+  while (true) {
+    mult = udiv64_32((uint64)1000000 << shift, tsc_khz, nullptr);
+    if ((mult >> 32) == 0 || shift == 0) {
+      break;
+    }
+    shift--;
+  }
+  tsc_mult = (uint32)mult;
+  tsc_shift = shift;
+  tsc_base = rdtsc();
+  tsc_enabled = true;
+}
+
+uint64 clock_monotonic_ns() {
+  if (!tsc_enabled) {
+    return (uint64)getTick() * (1000000000 / timer_frequency);
+  }
+  return cycles_to_ns(rdtsc() - tsc_base);
+}
+
+void clock_gettime_monotonic(timespec_t* ts) {
+  uint32 nsec;
+  uint64 sec = udiv64_32(clock_monotonic_ns(), 1000000000, &nsec);
+  ts->tv_sec = (uint32)sec;
+  ts->tv_nsec = nsec;
+}
+
+uint32 clock_tsc_khz() {
+  return tsc_enabled ? tsc_khz : 0;
+}
+
+bool clock_tsc_params(uint64* base, uint32* mult, uint32* shift) {
+  if (!tsc_enabled) {
+    return false;
+  }
+  *base = tsc_base;
+  *mult = tsc_mult;
+  *shift = tsc_shift;
+  return true;
+}
+
+uint64 clock_read_tsc() {
+  return tsc_enabled ? rdtsc() : 0;
+}
@@ -0,0 +1,29 @@
+#ifndef INTERRUPT_CLOCK_H
+#define INTERRUPT_CLOCK_H
+
+#include "common/common.h"
+
+struct timespec {
+  uint32 tv_sec;
+  uint32 tv_nsec;
+};
+typedef struct timespec timespec_t;
+
+// Calibrate TSC against PIT channel 2. Falls back to timer ticks if cpu has no TSC.
+void init_clock();
+
+// Nanoseconds since boot.
+uint64 clock_monotonic_ns();
+
+void clock_gettime_monotonic(timespec_t* ts);
+
+// TSC frequency in kHz, 0 if TSC is not used.
+uint32 clock_tsc_khz();
+
+// Raw TSC cycles, 0 if TSC is not used.
+uint64 clock_read_tsc();
+
+// Parameters to convert TSC to monotonic ns. Returns false if TSC is not used.
+bool clock_tsc_params(uint64* base, uint32* mult, uint32* shift);
+
+#endif
@@ -3,6 +3,7 @@
 #include "mem/gdt.h"
 #include "monitor/monitor.h"
 #include "interrupt/interrupt.h"
+#include "interrupt/timer.h"
 #include "utils/debug.h"
 
 extern void reload_idt(uint32);
@@ -106,6 +107,7 @@ void isr_handler(isr_params_t params) {
     // send reset signal to master
     outb(0x20, 0x20);
     in_irq_context = true;
+    timer_irq_enter(int_num);
   } else {
     // Not a hardware interrupt, enable interrupt as quickly as possible.
     enable_interrupt();
@@ -4,41 +4,274 @@
 #include "interrupt/timer.h"
 #include "task/thread.h"
 #include "task/scheduler.h"
+#include "sync/spinlock.h"
+#include "mem/vdso.h"
 
 uint32 tick = 0;
+uint32 timer_frequency = TIMER_FREQUENCY;
+
+// PIT input clock is 1193180Hz, and counter is 16-bit.
+#define PIT_CLOCK      1193180
+#define PIT_COUNT_MAX  0xFFFF
+
+static uint32 pit_divisor;
+static bool tickless_idle = false;
+// one-shot timer is armed by idle thread
+static bool idle_oneshot = false;
+static uint32 idle_oneshot_ticks = 0;
+
+// Hierarchical timing wheel. Level 0 has one slot per tick for the next 256 ticks; each upper
+// level has 64 slots, each slot covering a whole round of the level below. When level 0 wraps
+// around, the next slot of level 1 is cascaded down into it, and so on. Insert, cancel and
+// expiry are all O(1).
+static linked_list_t wheel_level0[TIMER_WHEEL_L0_SIZE];
+static linked_list_t wheel_levels[TIMER_WHEEL_LEVELS - 1][TIMER_WHEEL_LN_SIZE];
+// next tick to be processed by the wheel
+static uint32 wheel_tick = 0;
+static spinlock_t timer_lock;
 
 uint32 getTick() {
   return tick;
 }
 
+uint32 timer_ms_to_ticks(uint32 ms) {
+  // Round up, and wait at least one tick.
+  uint32 ticks;
+  if (ms > 0xFFFFFFFF / timer_frequency - 1000) {
+    ticks = ms / 1000 * timer_frequency;
+  } else {
+    ticks = (ms * timer_frequency + 999) / 1000;
+  }
+  return ticks > 0 ? ticks : 1;
+}
+
+// Level n >= 1 slot index of tick.
+static uint32 wheel_index(uint32 t, uint32 level) {
+  uint32 shift = TIMER_WHEEL_L0_BITS + (level - 1) * TIMER_WHEEL_LN_BITS;
+  return (t >> shift) & (TIMER_WHEEL_LN_SIZE - 1);
+}
+
+// timer_lock must be held.
+static void wheel_insert(timer_event_t* event) {
+  uint32 expire_tick = event->expire_tick;
+  uint32 delta = expire_tick - wheel_tick;
+  linked_list_t* slot;
+  if ((int32)delta < 0) {
+    // Already expired, run it at next tick.
+    slot = &wheel_level0[wheel_tick & (TIMER_WHEEL_L0_SIZE - 1)];
+  } else if (delta < TIMER_WHEEL_L0_SIZE) {
+    slot = &wheel_level0[expire_tick & (TIMER_WHEEL_L0_SIZE - 1)];
+  } else {
+    // Find the lowest level that covers delta, and clamp it to the max range of the wheel.
+    uint32 level = 1;
+    uint32 range = TIMER_WHEEL_L0_SIZE * TIMER_WHEEL_LN_SIZE;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= range) {
+      level++;
+      range *= TIMER_WHEEL_LN_SIZE;
+    }
+    if (delta >= range) {
+      expire_tick = wheel_tick + range - 1;
+    }
+    slot = &wheel_levels[level - 1][wheel_index(expire_tick, level)];
+  }
+  linked_list_append(slot, &event->node);
+  event->slot = slot;
+}
+
+void timer_add(timer_event_t* event, uint32 delay_ms, timer_func_t func, void* arg) {
+  event->func = func;
+  event->arg = arg;
+  event->node.ptr = event;
+
+  spinlock_lock_irqsave(&timer_lock);
+  event->expire_tick = tick + timer_ms_to_ticks(delay_ms);
+  wheel_insert(event);
+  spinlock_unlock_irqrestore(&timer_lock);
+}
+
+bool timer_cancel(timer_event_t* event) {
+  spinlock_lock_irqsave(&timer_lock);
+  bool pending = (event->slot != nullptr);
+  if (pending) {
+    linked_list_remove(event->slot, &event->node);
+    event->slot = nullptr;
+  }
+  spinlock_unlock_irqrestore(&timer_lock);
+  return pending;
+}
+
+// Move all events of a slot at given level down to lower levels. Returns the slot index, so
+// that caller knows whether this level has wrapped around too.
+static uint32 cascade(uint32 level) {
+  uint32 index = wheel_index(wheel_tick, level);
+  linked_list_t events;
+  linked_list_move(&events, &wheel_levels[level - 1][index]);
+  linked_list_node_t* node = events.head;
+  while (node != nullptr) {
+    linked_list_node_t* next_node = node->next;
+    wheel_insert((timer_event_t*)node->ptr);
+    node = next_node;
+  }
+  return index;
+}
+
+static void run_expired_timers() {
+  spinlock_lock_irqsave(&timer_lock);
+  while ((int32)(tick - wheel_tick) >= 0) {
+    uint32 index = wheel_tick & (TIMER_WHEEL_L0_SIZE - 1);
+    if (index == 0) {
+      for (uint32 level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (cascade(level) != 0) {
+          break;
+        }
+      }
+    }
+
+    linked_list_t expired;
+    linked_list_move(&expired, &wheel_level0[index]);
+    linked_list_node_t* node = expired.head;
+    while (node != nullptr) {
+      ((timer_event_t*)node->ptr)->slot = &expired;
+      node = node->next;
+    }
+    wheel_tick++;
+
+    // Callbacks may cancel other expired events, so pop them one by one.
+    while (expired.size > 0) {
+      timer_event_t* event = (timer_event_t*)expired.head->ptr;
+      linked_list_remove(&expired, expired.head);
+      event->slot = nullptr;
+      spinlock_unlock_irqrestore(&timer_lock);
+      event->func(event->arg);
+      spinlock_lock_irqsave(&timer_lock);
+    }
+  }
+  spinlock_unlock_irqrestore(&timer_lock);
+}
+
+static void sleep_timeout(void* arg) {
+  add_thread_to_schedule((tcb_t*)arg);
+}
+
+void timer_sleep_ms(uint32 ms) {
+  tcb_t* thread = get_crt_thread();
+  timer_event_t timer;
+  schedule_mark_thread_block();
+  timer_add(&timer, ms, sleep_timeout, thread);
+  // If the timer has already fired, thread is READY and yield just gives up cpu.
+  schedule_thread_yield();
+}
+
+// Ticks from now to the next tick which has timers to run, or upper wheel levels to cascade.
+// At most limit. Interrupt must be DISABLED.
+static uint32 ticks_to_next_timer(uint32 limit) {
+  for (uint32 t = wheel_tick; (int32)(t - tick) < (int32)limit; t++) {
+    uint32 index = t & (TIMER_WHEEL_L0_SIZE - 1);
+    if (index == 0 || wheel_level0[index].size > 0) {
+      return t - tick;
+    }
+  }
+  return limit;
+}
+
+static void pit_set_periodic() {
+  // channel 0, lobyte/hibyte, mode 3 (square wave)
+  outb(0x43, 0x36);
+  outb(0x40, (uint8)(pit_divisor & 0xFF));
+  outb(0x40, (uint8)((pit_divisor >> 8) & 0xFF));
+}
+
+static void pit_set_oneshot(uint32 count) {
+  // channel 0, lobyte/hibyte, mode 0 (interrupt on terminal count)
+  outb(0x43, 0x30);
+  outb(0x40, (uint8)(count & 0xFF));
+  outb(0x40, (uint8)((count >> 8) & 0xFF));
+}
+
+static uint32 pit_read_count() {
+  // latch channel 0 counter
+  outb(0x43, 0x00);
+  uint8 l = inb(0x40);
+  uint8 h = inb(0x40);
+  return ((uint32)h << 8) | l;
+}
+
+// The one-shot range is limited by the 16-bit PIT counter, e.g. 13 ticks (52ms) at 250Hz.
+void timer_idle_enter() {
+  if (!tickless_idle) {
+    return;
+  }
+  uint32 max_ticks = PIT_COUNT_MAX / pit_divisor;
+  uint32 ticks = ticks_to_next_timer(max_ticks);
+  if (ticks <= 1) {
+    return;
+  }
+  idle_oneshot_ticks = ticks;
+  idle_oneshot = true;
+  pit_set_oneshot(ticks * pit_divisor);
+}
+
+void timer_irq_enter(uint32 int_num) {
+  if (!idle_oneshot) {
+    return;
+  }
+  idle_oneshot = false;
+
+  uint32 programmed = idle_oneshot_ticks * pit_divisor;
+  uint32 remaining = (int_num == IRQ0_INT_NUM) ? 0 : pit_read_count();
+  uint32 elapsed;
+  if (remaining == 0 || remaining > programmed) {
+    // One-shot has expired (counter wraps after terminal count), and the timer interrupt
+    // itself accounts the last tick.
+    elapsed = idle_oneshot_ticks - 1;
+  } else {
+    elapsed = (programmed - remaining) / pit_divisor;
+  }
+  tick += elapsed;
+  vdso_update_time();
+  schedule_idle_ticks(elapsed);
+
+  pit_set_periodic();
+}
+
 static void timer_callback(isr_params_t regs) {
-  if (tick % TIMER_FREQUENCY == 0) {
-    //monitor_printf("second: %d\n", tick / TIMER_FREQUENCY);
+  if (tick % timer_frequency == 0) {
+    //monitor_printf("second: %d\n", tick / timer_frequency);
   }
   tick++;
+  vdso_update_time();
+
+  run_expired_timers();
 
   // Check current thread time slice.
-  tcb_t* crt_thread = get_crt_thread();
-  crt_thread->ticks++;
-  if (crt_thread->ticks >= crt_thread->priority) {
-    crt_thread->need_reschedule = true;
-  }
+  schedule_tick();
 }
 
-void init_timer(uint32 frequency) {
+void init_timer(uint32 frequency, bool tickless_idle_enabled) {
+  for (uint32 i = 0; i < TIMER_WHEEL_L0_SIZE; i++) {
+    linked_list_init(&wheel_level0[i]);
+  }
+  for (uint32 level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+    for (uint32 i = 0; i < TIMER_WHEEL_LN_SIZE; i++) {
+      linked_list_init(&wheel_levels[level][i]);
+    }
+  }
+  wheel_tick = tick;
+  spinlock_init(&timer_lock);
+
   // register our timer callback.
   register_interrupt_handler(IRQ0_INT_NUM, &timer_callback);
 
   // the divisor must be small enough to fit into 16-bits.
-  uint32 divisor = 1193180 / frequency;
-
-  // send the command byte.
-  outb(0x43, 0x36);
-
-  uint8 l = (uint8)(divisor & 0xFF);
-  uint8 h = (uint8)((divisor>>8) & 0xFF);
+  uint32 divisor = PIT_CLOCK / frequency;
+  if (divisor > PIT_COUNT_MAX) {
+    divisor = PIT_COUNT_MAX;
+  } else if (divisor == 0) {
+    divisor = 1;
+  }
+  pit_divisor = divisor;
+  timer_frequency = PIT_CLOCK / divisor;
+  tickless_idle = tickless_idle_enabled;
 
-  // Send the frequency divisor.
-  outb(0x40, l);
-  outb(0x40, h);
+  pit_set_periodic();
 }
@@ -2,11 +2,57 @@
 #define INTERRUPT_IRQ_H
 
 #include "common/common.h"
+#include "utils/linked_list.h"
 
-#define TIMER_FREQUENCY 50
+// Default timer config passed to init_timer at boot. PIT frequency must be >= 19Hz.
+#define TIMER_FREQUENCY 250
+// Stop periodic tick while cpu is idle, and only wake up for the next timer event.
+#define TIMER_TICKLESS_IDLE true
 
-void init_timer(uint32 frequency);
+// Timing wheel: level 0 has 256 slots of one tick, 3 upper levels have 64 slots each,
+// covering 2^26 ticks in total. Longer delays are clamped.
+#define TIMER_WHEEL_LEVELS   4
+#define TIMER_WHEEL_L0_BITS  8
+#define TIMER_WHEEL_LN_BITS  6
+#define TIMER_WHEEL_L0_SIZE  (1 << TIMER_WHEEL_L0_BITS)
+#define TIMER_WHEEL_LN_SIZE  (1 << TIMER_WHEEL_LN_BITS)
+
+typedef void (*timer_func_t)(void* arg);
+
+// One-shot timer event. The struct is owned by caller and must stay valid until it expires
+// or is cancelled. Callback is run in timer interrupt context.
+struct timer_event {
+  uint32 expire_tick;
+  timer_func_t func;
+  void* arg;
+  linked_list_node_t node;
+  // wheel slot this event is in, nullptr if not pending
+  linked_list_t* slot;
+};
+typedef struct timer_event timer_event_t;
+
+extern uint32 timer_frequency;
+
+void init_timer(uint32 frequency, bool tickless_idle);
 
 uint32 getTick();
 
+uint32 timer_ms_to_ticks(uint32 ms);
+
+void timer_add(timer_event_t* event, uint32 delay_ms, timer_func_t func, void* arg);
+
+// Returns true if the event was still pending.
+bool timer_cancel(timer_event_t* event);
+
+// Block current thread for ms milliseconds.
+void timer_sleep_ms(uint32 ms);
+
+// Called by cpu idle thread with interrupt disabled, right before halting cpu. In tickless
+// mode it switches timer to one-shot, firing at the next timer event.
+void timer_idle_enter();
+
+// Called on every hardware interrupt before its handler, to catch up ticks elapsed in
+// tickless idle and restore periodic timer.
+void timer_irq_enter(uint32 int_num);
+
 #endif
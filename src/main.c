@@ -1,9 +1,11 @@
 #include "monitor/monitor.h"
 #include "interrupt/timer.h"
+#include "interrupt/clock.h"
 #include "interrupt/interrupt.h"
 #include "mem/gdt.h"
 #include "mem/paging.h"
 #include "mem/kheap.h"
+#include "mem/vdso.h"
 #include "task/thread.h"
 #include "task/process.h"
 #include "task/scheduler.h"
@@ -28,11 +30,13 @@ int main() {
   print_welcome();
 
   init_idt();
-  init_timer(TIMER_FREQUENCY);
+  init_timer(TIMER_FREQUENCY, TIMER_TICKLESS_IDLE);
+  init_clock();
 
   init_paging();
   init_kheap();
   init_paging_stage2();
+  init_vdso();
 
   init_hard_disk();
   init_file_system();
@@ -41,7 +45,7 @@ int main() {
 
   init_task_manager();
   init_process_manager();
-  init_scheduler();
+  init_scheduler(SCHEDULER_POLICY);
 
   // Never should reach here.
   PANIC();
@@ -0,0 +1,33 @@
+#include "common/stdlib.h"
+#include "mem/dma.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+
+void* dma_alloc_pages(uint32 pages, uint32* phy_addr) {
+  int32 frame = allocate_phy_frames(pages);
+  if (frame < 0) {
+    return nullptr;
+  }
+  // kheap only provides the virtual range, its pages are re-mapped to the contiguous frames.
+  uint32 vaddr = (uint32)kmalloc_aligned(pages * PAGE_SIZE);
+  for (uint32 i = 0; i < pages; i++) {
+    map_page_to_frame(vaddr + i * PAGE_SIZE, frame + i);
+  }
+  memset((void*)vaddr, 0, pages * PAGE_SIZE);
+  *phy_addr = frame * PAGE_SIZE;
+  return (void*)vaddr;
+}
+
+int32 dma_buffer_phy(void* addr, bool device_writes) {
+  volatile char* ptr = (char*)addr;
+  if (device_writes) {
+    *ptr = *ptr;
+  } else {
+    (void)*ptr;
+  }
+  int32 frame = get_page_frame((uint32)addr);
+  if (frame < 0) {
+    return -1;
+  }
+  return frame * PAGE_SIZE + (uint32)addr % PAGE_SIZE;
+}
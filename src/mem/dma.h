@@ -0,0 +1,18 @@
+#ifndef MEM_DMA_H
+#define MEM_DMA_H
+
+#include "common/common.h"
+
+// Memory for device DMA. Devices address physical memory, so driver buffers either come
+// from physically contiguous frames, or are translated page by page.
+
+// Allocate pages of kernel memory backed by contiguous frames, zeroed. Returns the virtual
+// address and stores the physical one in *phy_addr, or returns nullptr. Never freed, drivers
+// allocate them once at init.
+void* dma_alloc_pages(uint32 pages, uint32* phy_addr);
+
+// Physical address of a buffer byte, or -1. The page is touched first so that it's mapped,
+// and if device writes to it, not shared copy-on-write.
+int32 dma_buffer_phy(void* addr, bool device_writes);
+
+#endif
@@ -5,12 +5,19 @@
 
 extern void load_gdt(gdt_ptr_t*);
 extern void refresh_tss();
+extern void sysenter_entry();
+
+#define MSR_SYSENTER_CS   0x174
+#define MSR_SYSENTER_ESP  0x175
+#define MSR_SYSENTER_EIP  0x176
 
 static gdt_ptr_t gdt_ptr;
 static gdt_entry_t gdt_entries[7];
 
 static tss_entry_t tss_entry;
 
+static bool sysenter_enabled = false;
+
 static void refresh_gdt() {
   load_gdt(&gdt_ptr);
 }
@@ -45,6 +52,29 @@ static void write_tss(uint32 num, uint16 ss0, uint32 esp0) {
   gdt_set_gate(num, base, limit, DESC_P | DESC_DPL_0 | DESC_S_SYS | DESC_TYPE_TSS, 0x0);
 }
 
+static void wrmsr(uint32 msr, uint32 value) {
+  asm volatile("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+static bool cpu_has_sep() {
+  uint32 eax = 1, ebx, ecx, edx;
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+  return (edx & (1 << 11)) != 0;
+}
+
+// SYSENTER loads esp from MSR, which can not follow the running thread without a wrmsr on
+// every context switch. So it points to tss esp0 instead, and sysenter_entry loads the real
+// kernel stack from there.
+static void init_sysenter() {
+  if (!cpu_has_sep()) {
+    return;
+  }
+  wrmsr(MSR_SYSENTER_CS, SELECTOR_K_CODE);
+  wrmsr(MSR_SYSENTER_ESP, (uint32)&tss_entry.esp0);
+  wrmsr(MSR_SYSENTER_EIP, (uint32)sysenter_entry);
+  sysenter_enabled = true;
+}
+
 void init_gdt() {
   gdt_ptr.limit = (sizeof(gdt_entry_t) * 7) - 1;
   gdt_ptr.base = (uint32)&gdt_entries;
@@ -56,21 +86,27 @@ void init_gdt() {
   gdt_set_gate(1, 0, 0xFFFFF, DESC_P | DESC_DPL_0 | DESC_S_CODE | DESC_TYPE_CODE, FLAG_G_4K | FLAG_D_32);
   // kernel data
   gdt_set_gate(2, 0, 0xFFFFF, DESC_P | DESC_DPL_0 | DESC_S_DATA | DESC_TYPE_DATA, FLAG_G_4K | FLAG_D_32);
-  // video: only 8 pages
-  gdt_set_gate(3, 0, 7, DESC_P | DESC_DPL_0 | DESC_S_DATA | DESC_TYPE_DATA, FLAG_G_4K | FLAG_D_32);
-
   // user code
-  gdt_set_gate(4, 0, 0xBFFFF, DESC_P | DESC_DPL_3 | DESC_S_CODE | DESC_TYPE_CODE, FLAG_G_4K | FLAG_D_32);
+  gdt_set_gate(3, 0, 0xBFFFF, DESC_P | DESC_DPL_3 | DESC_S_CODE | DESC_TYPE_CODE, FLAG_G_4K | FLAG_D_32);
   // user data
-  gdt_set_gate(5, 0, 0xBFFFF, DESC_P | DESC_DPL_3 | DESC_S_DATA | DESC_TYPE_DATA, FLAG_G_4K | FLAG_D_32);
+  gdt_set_gate(4, 0, 0xBFFFF, DESC_P | DESC_DPL_3 | DESC_S_DATA | DESC_TYPE_DATA, FLAG_G_4K | FLAG_D_32);
+
+  // video: only 8 pages
+  gdt_set_gate(5, 0, 7, DESC_P | DESC_DPL_0 | DESC_S_DATA | DESC_TYPE_DATA, FLAG_G_4K | FLAG_D_32);
 
   // tss: 
   write_tss(6, 0x10, 0x0);
 
   refresh_gdt((uint32)&gdt_ptr);
   refresh_tss();
+
+  init_sysenter();
 }
 
 void update_tss_esp(uint32 esp) {
   tss_entry.esp0 = esp;
 }
+
+bool sysenter_is_enabled() {
+  return sysenter_enabled;
+}
@@ -35,9 +35,10 @@
 #define SELECTOR_K_CODE   ((1 << 3) + (TI_GDT << 2) + RPL0)
 #define SELECTOR_K_DATA   ((2 << 3) + (TI_GDT << 2) + RPL0)
 #define SELECTOR_K_STACK  SELECTOR_K_DATA
-#define SELECTOR_K_GS     ((3 << 3) + (TI_GDT << 2) + RPL0)  // video segment
-#define SELECTOR_U_CODE   ((4 << 3) + (TI_GDT << 2) + RPL3)
-#define SELECTOR_U_DATA   ((5 << 3) + (TI_GDT << 2) + RPL3)
+// SYSEXIT requires user code and data to follow kernel code and data, in this order.
+#define SELECTOR_U_CODE   ((3 << 3) + (TI_GDT << 2) + RPL3)
+#define SELECTOR_U_DATA   ((4 << 3) + (TI_GDT << 2) + RPL3)
+#define SELECTOR_K_GS     ((5 << 3) + (TI_GDT << 2) + RPL0)  // video segment
 
 
 // ****************************************************************************
@@ -95,4 +96,7 @@ void init_gdt();
 
 void update_tss_esp(uint32 esp);
 
+// Whether SYSENTER/SYSEXIT fast syscall is enabled on this cpu.
+bool sysenter_is_enabled();
+
 #endif
@@ -1,6 +1,7 @@
 #include "common/stdlib.h"
 #include "mem/paging.h"
 #include "mem/kheap.h"
+#include "mem/vdso.h"
 #include "monitor/monitor.h"
 #include "sync/yieldlock.h"
 #include "task/thread.h"
@@ -25,8 +26,10 @@ static bool copy_on_write_ready = false;
 static hash_table_t frame_cow_ref_counts;
 static yieldlock_t frame_cow_ref_counts_lock;
 
-// locks for page copy
-static yieldlock_t page_copy_lock;
+// kmap state used before multi-task is enabled
+static kmap_ctrl_t boot_kmap_ctrl;
+
+extern uint32 get_eflags();
 
 void init_paging() {
   // Initialize phy_frames_map. Note we have already used the first 3MB for kernel initialization.
@@ -56,8 +59,6 @@ void init_paging_stage2() {
   hash_table_init(&frame_cow_ref_counts);
   yieldlock_init(&frame_cow_ref_counts_lock);
 
-  yieldlock_init(&page_copy_lock);
-
   copy_on_write_ready = true;
 }
 
@@ -72,6 +73,17 @@ int32 allocate_phy_frame() {
   return (int32)frame;
 }
 
+int32 allocate_phy_frames(uint32 num) {
+  yieldlock_lock(&phy_frames_map_lock);
+  uint32 frame;
+  if (!bitmap_allocate_first_free_range(&phy_frames_map, num, &frame)) {
+    yieldlock_unlock(&phy_frames_map_lock);
+    return -1;
+  }
+  yieldlock_unlock(&phy_frames_map_lock);
+  return (int32)frame;
+}
+
 void release_phy_frame(uint32 frame) {
   yieldlock_lock(&phy_frames_map_lock);
   bitmap_clear_bit(&phy_frames_map, frame);
@@ -101,6 +113,87 @@ page_directory_t* get_crt_page_directory() {
   return current_page_directory;
 }
 
+static void invalidate_page(uint32 virtual_addr) {
+  asm volatile("invlpg (%0)" : : "r"(virtual_addr) : "memory");
+}
+
+// ********************************* kmap ***************************************
+// kmap slots live in the shared kernel space, so only one set of them can be installed on
+// the cpu at a time. Each thread keeps its own kmap_ctrl_t, and the scheduler swaps the
+// installed slots on context switch. So unlike a single global copy window, no lock is
+// needed and a thread can be preempted while holding kmap slots.
+static kmap_ctrl_t* get_crt_kmap_ctrl() {
+  tcb_t* thread = get_crt_thread();
+  if (thread == nullptr) {
+    return &boot_kmap_ctrl;
+  }
+  return &thread->kmap;
+}
+
+static void set_kmap_slot_pte(uint32 slot, uint32 frame, bool present) {
+  uint32 virtual_addr = KMAP_VADDR_START + slot * PAGE_SIZE;
+  pte_t* pte = (pte_t*)PAGE_TABLES_VIRTUAL + (virtual_addr >> 12);
+  if (present) {
+    pte->present = 1;
+    pte->rw = 1;
+    pte->user = 0;
+    pte->frame = frame;
+  } else {
+    *((uint32*)pte) = 0;
+  }
+  invalidate_page(virtual_addr);
+}
+
+void* kmap_atomic(uint32 frame) {
+  // Disable interrupt so that context switch can not observe a half-installed slot.
+  uint32 eflags = get_eflags();
+  disable_interrupt();
+
+  kmap_ctrl_t* ctrl = get_crt_kmap_ctrl();
+  if (ctrl->slots_used >= KMAP_SLOTS_NUM) {
+    monitor_printf("kmap slots exhausted\n");
+    PANIC();
+  }
+  uint32 slot = ctrl->slots_used++;
+  ctrl->frames[slot] = frame;
+  set_kmap_slot_pte(slot, frame, true);
+
+  if (eflags & (1 << 9)) {
+    enable_interrupt();
+  }
+  return (void*)(KMAP_VADDR_START + slot * PAGE_SIZE);
+}
+
+void kunmap_atomic(void* vaddr) {
+  uint32 eflags = get_eflags();
+  disable_interrupt();
+
+  kmap_ctrl_t* ctrl = get_crt_kmap_ctrl();
+  ASSERT(ctrl->slots_used > 0);
+  uint32 slot = ctrl->slots_used - 1;
+  // kmap slots are used like a stack.
+  ASSERT((uint32)vaddr == KMAP_VADDR_START + slot * PAGE_SIZE);
+  ctrl->slots_used--;
+  set_kmap_slot_pte(slot, 0, false);
+
+  if (eflags & (1 << 9)) {
+    enable_interrupt();
+  }
+}
+
+// Note: interrupt must be DISABLED before entering this function.
+void kmap_switch(kmap_ctrl_t* old_ctrl, kmap_ctrl_t* next_ctrl) {
+  uint32 old_used = old_ctrl->slots_used;
+  uint32 next_used = next_ctrl->slots_used;
+  for (uint32 i = 0; i < max(old_used, next_used); i++) {
+    if (i < next_used) {
+      set_kmap_slot_pte(i, next_ctrl->frames[i], true);
+    } else {
+      set_kmap_slot_pte(i, 0, false);
+    }
+  }
+}
+
 static int32 change_cow_frame_refcount(uint32 frame, int32 refcount_delta) {
   if (!copy_on_write_ready) {
     return 0;
@@ -157,6 +250,17 @@ void page_fault_handler(isr_params_t params) {
   //  "page fault: %x, present %d, write %d, user-mode %d, reserved %d\n",
   //  faulting_address, present, rw, user_mode, reserved);
 
+  // vDSO pages are read-only, so writes to them are not copy-on-write faults.
+  if (faulting_address >= VDSO_VADDR_START && faulting_address < VDSO_VADDR_END) {
+    if (!vdso_handle_page_fault(faulting_address, rw)) {
+      monitor_printf("segmentation fault: write to vdso page %x\n", faulting_address);
+      process_exit(-1);
+      // process_exit returns if other threads are still running on this process.
+      schedule_thread_exit();
+    }
+    return;
+  }
+
   map_page(faulting_address / PAGE_SIZE * PAGE_SIZE);
   reload_page_directory(current_page_directory);
 }
@@ -233,17 +337,13 @@ static void map_page_with_frame_impl(uint32 virtual_addr, int32 frame) {
         }
 
         // Do NOT kmalloc page for copying, because kmalloc may trigger another page fault
-        // which will result in a deadlock.
-        yieldlock_lock(&page_copy_lock);
-        void* copy_page = (void*)COPIED_PAGE_VADDR;
-        map_page_with_frame_impl((uint32)copy_page, frame);
+        // which will result in a deadlock. Use a kmap slot of current thread instead.
+        void* copy_page = kmap_atomic(frame);
         memcpy(copy_page, (void*)(virtual_addr / PAGE_SIZE * PAGE_SIZE), PAGE_SIZE);
-        yieldlock_unlock(&page_copy_lock);
+        kunmap_atomic(copy_page);
         pte->frame = frame;
         pte->rw = 1;
-
-        //kfree(copy_page);
-        release_pages((uint32)copy_page, 1, false);
+        invalidate_page(virtual_addr);
       } else {
         //monitor_printf("cow rw %x on process %d\n", virtual_addr, get_crt_thread()->process->id);
         pte->rw = 1;
@@ -267,6 +367,33 @@ void map_page(uint32 virtual_addr) {
   map_page_with_frame(virtual_addr, -1);
 }
 
+void map_page_to_frame(uint32 virtual_addr, uint32 frame) {
+  release_pages(virtual_addr, 1, true);
+  map_page_with_frame(virtual_addr, frame);
+}
+
+void map_user_page_readonly(uint32 virtual_addr, uint32 frame) {
+  if (multi_task_is_enabled()) {
+    yieldlock_lock(&get_crt_thread()->process->page_dir_lock);
+  }
+  map_page_with_frame_impl(virtual_addr, frame);
+  pte_t* pte = (pte_t*)PAGE_TABLES_VIRTUAL + (virtual_addr >> 12);
+  pte->rw = 0;
+  invalidate_page(virtual_addr);
+  if (multi_task_is_enabled()) {
+    yieldlock_unlock(&get_crt_thread()->process->page_dir_lock);
+  }
+}
+
+int32 get_page_frame(uint32 virtual_addr) {
+  pte_t* pte = (pte_t*)PAGE_TABLES_VIRTUAL + (virtual_addr >> 12);
+  pde_t* pde = (pde_t*)PAGE_DIR_VIRTUAL + (virtual_addr >> 22);
+  if (!pde->present || !pte->present) {
+    return -1;
+  }
+  return pte->frame;
+}
+
 static void release_page(uint32 virtual_addr, bool free_frame) {
   // reset pte
   uint32 pte_index = virtual_addr >> 12;
@@ -387,6 +514,12 @@ page_directory_t clone_crt_page_dir() {
       if (!new_pte->present) {
         continue;
       }
+      // vDSO pages are not copied, child maps its own on first access.
+      uint32 virtual_addr = (i * 1024 + j) * PAGE_SIZE;
+      if (virtual_addr >= VDSO_VADDR_START && virtual_addr < VDSO_VADDR_END) {
+        *((uint32*)new_pte) = 0;
+        continue;
+      }
       // Mark copy-on-write: increase copy-on-write ref count.
       crt_pte->rw = 0;
       new_pte->rw = 0;
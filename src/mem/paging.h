@@ -9,7 +9,9 @@
 #define PAGE_SIZE  4096
 
 // ********************* virtual memory layout *********************************
+// Kernel space starts at 0xC0000000, it's shared by all processes and below it is user space.
 // 0xC0000000 ... 0xC0100000 ... 0xC0400000  boot & reserverd                4MB
+#define KERNEL_VADDR_START            0xC0000000
 // 0xC0400000 ... 0xC0800000 page tables, 0xC0701000 page directory          4MB
 // 0xC0800000 ... 0xC0900000 kernel load                                     1MB
 #define PAGE_DIR_VIRTUAL              0xC0701000
@@ -20,7 +22,10 @@
 
 #define COPIED_PAGE_DIR_VADDR         0xFFFFE000
 #define COPIED_PAGE_TABLE_VADDR       0xFFFFF000
-#define COPIED_PAGE_VADDR             0xFFFFF000
+
+// 0xFFFF8000 ... 0xFFFFC000 kmap slots for temporary frame mappings         16KB
+#define KMAP_VADDR_START              0xFFFF8000
+#define KMAP_SLOTS_NUM                4
 
 // ********************* physical memory layout ********************************
 // 0x00000000 ... 0x00100000  boot & reserved                                1MB
@@ -47,6 +52,14 @@ typedef struct page_table_entry {
 
 typedef pte_t pde_t;
 
+// Per-thread kmap state. Each slot holds the frame mapped at KMAP_VADDR_START + i * PAGE_SIZE
+// while this thread is running, and is re-installed when the thread is switched in.
+struct kmap_ctrl {
+  uint32 frames[KMAP_SLOTS_NUM];
+  uint32 slots_used;
+};
+typedef struct kmap_ctrl kmap_ctrl_t;
+
 // 4KB
 typedef struct page_directory {
   uint32 page_dir_entries_phy;  // [1024]
@@ -63,16 +76,37 @@ void enable_paging();
 int32 allocate_phy_frame();
 void release_phy_frame(uint32 frame);
 
+// Allocate num physically contiguous frames. Returns the first frame, or -1.
+int32 allocate_phy_frames(uint32 num);
+
 // Set all to zero for a page.
 void clear_page(uint32 addr);
 
 // Map virtual page to a physical frame.
 void map_page(uint32 virtual_addr);
 
+// Map virtual page to a given frame, releasing the frame it was mapped to, if any.
+void map_page_to_frame(uint32 virtual_addr, uint32 frame);
+
+// Map a frame to user space read-only. The frame is not owned by this mapping, so it must
+// be unmapped without releasing the frame.
+void map_user_page_readonly(uint32 virtual_addr, uint32 frame);
+
+// Physical frame a virtual page is mapped to, or -1 if not mapped.
+int32 get_page_frame(uint32 virtual_addr);
+
 // Release virtual page mapping and maybe return the physical frame(s).
 void release_pages(uint32 virtual_addr, uint32 pages, bool release_frame);
 void release_pages_tables(uint32 pde_index_start, uint32 num);
 
+// Temporarily map a physical frame on a free kmap slot of current thread, and return its
+// virtual address. Mappings must be released in reverse order by kunmap_atomic.
+void* kmap_atomic(uint32 frame);
+void kunmap_atomic(void* vaddr);
+
+// Re-install kmap slots of the next thread on context switch.
+void kmap_switch(kmap_ctrl_t* old_ctrl, kmap_ctrl_t* next_ctrl);
+
 // Switch to a different page directory.
 page_directory_t* get_crt_page_directory();
 void reload_page_directory(page_directory_t* dir);
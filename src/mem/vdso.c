@@ -0,0 +1,92 @@
+#include "common/stdlib.h"
+#include "mem/vdso.h"
+#include "mem/paging.h"
+#include "mem/kheap.h"
+#include "mem/gdt.h"
+#include "interrupt/timer.h"
+#include "interrupt/clock.h"
+#include "monitor/monitor.h"
+#include "task/thread.h"
+#include "task/process.h"
+#include "task/scheduler.h"
+#include "utils/debug.h"
+
+// Kernel mapping of the shared time page.
+static vdso_time_page_t* time_page = nullptr;
+static uint32 time_page_frame = 0;
+
+void init_vdso() {
+  vdso_time_page_t* page = (vdso_time_page_t*)kmalloc_aligned(PAGE_SIZE);
+  map_page((uint32)page);
+  memset(page, 0, PAGE_SIZE);
+  int32 frame = get_page_frame((uint32)page);
+  ASSERT(frame > 0);
+
+  page->tick = getTick();
+  page->timer_frequency = timer_frequency;
+  uint64 tsc_base;
+  uint32 tsc_mult, tsc_shift;
+  if (clock_tsc_params(&tsc_base, &tsc_mult, &tsc_shift)) {
+    page->tsc_enabled = 1;
+    page->tsc_base = tsc_base;
+    page->tsc_mult = tsc_mult;
+    page->tsc_shift = tsc_shift;
+  }
+  if (sysenter_is_enabled()) {
+    page->features |= VDSO_FEATURE_SYSENTER;
+  }
+
+  time_page_frame = frame;
+  time_page = page;
+}
+
+// Seqlock writer. There is only one writer (timer interrupt), and user readers retry when
+// they see an odd or changed seq.
+void vdso_update_time() {
+  if (time_page == nullptr) {
+    return;
+  }
+  time_page->seq++;
+  asm volatile("" : : : "memory");
+  time_page->tick = getTick();
+  asm volatile("" : : : "memory");
+  time_page->seq++;
+}
+
+// Process page frame is allocated on the first access of this process.
+static uint32 get_process_page_frame(pcb_t* process) {
+  yieldlock_lock(&process->lock);
+  if (process->vdso_frame == 0) {
+    int32 frame = allocate_phy_frame();
+    if (frame < 0) {
+      monitor_printf("couldn't alloc frame for vdso page\n");
+      PANIC();
+    }
+    vdso_process_page_t* page = (vdso_process_page_t*)kmap_atomic(frame);
+    memset(page, 0, PAGE_SIZE);
+    page->pid = process->id;
+    kunmap_atomic(page);
+    process->vdso_frame = frame;
+  }
+  yieldlock_unlock(&process->lock);
+  return process->vdso_frame;
+}
+
+bool vdso_handle_page_fault(uint32 virtual_addr, bool write) {
+  pcb_t* process = get_crt_thread()->process;
+  if (write || process == nullptr || time_page == nullptr) {
+    return false;
+  }
+
+  virtual_addr = virtual_addr / PAGE_SIZE * PAGE_SIZE;
+  if (virtual_addr == VDSO_TIME_VADDR) {
+    map_user_page_readonly(virtual_addr, time_page_frame);
+  } else {
+    map_user_page_readonly(virtual_addr, get_process_page_frame(process));
+  }
+  return true;
+}
+
+void vdso_unmap() {
+  release_pages(VDSO_VADDR_START, (VDSO_VADDR_END - VDSO_VADDR_START) / PAGE_SIZE, false);
+}
@@ -0,0 +1,54 @@
+#ifndef MEM_VDSO_H
+#define MEM_VDSO_H
+
+#include "common/common.h"
+
+// vDSO pages are mapped read-only into the top of every user space, so that user programs
+// can read time and their own pid without trapping into kernel. This header is shared with
+// user programs, so it must only depend on common types.
+//
+// 0xBFFFE000 ... 0xBFFFF000  time page, one frame shared by all processes
+// 0xBFFFF000 ... 0xC0000000  process page, one frame per process
+#define VDSO_VADDR_START     0xBFFFE000
+#define VDSO_TIME_VADDR      0xBFFFE000
+#define VDSO_PROCESS_VADDR   0xBFFFF000
+#define VDSO_VADDR_END       0xC0000000
+
+// cpu features user runtime may use
+#define VDSO_FEATURE_SYSENTER  (1 << 0)
+
+// Updated by kernel on every timer tick. Readers must retry if seq is odd (update in
+// progress) or changes across the read.
+struct vdso_time_page {
+  volatile uint32 seq;
+  volatile uint32 tick;
+  uint32 timer_frequency;
+  // ns = (rdtsc - tsc_base) * tsc_mult >> tsc_shift, if tsc_enabled
+  uint32 tsc_enabled;
+  uint32 tsc_mult;
+  uint32 tsc_shift;
+  uint64 tsc_base;
+  // VDSO_FEATURE_* bits, at offset 0x20 which syscall_trigger.S reads
+  uint32 features;
+};
+typedef struct vdso_time_page vdso_time_page_t;
+
+struct vdso_process_page {
+  uint32 pid;
+};
+typedef struct vdso_process_page vdso_process_page_t;
+
+
+// ****************************************************************************
+void init_vdso();
+
+// Publish current tick to the time page. Called by timer with interrupt disabled.
+void vdso_update_time();
+
+// Handle page fault in vDSO range. Returns false if the access is illegal.
+bool vdso_handle_page_fault(uint32 virtual_addr, bool write);
+
+// Unmap vDSO pages of current process, without releasing frames.
+void vdso_unmap();
+
+#endif
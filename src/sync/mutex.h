@@ -2,16 +2,13 @@
 #define SYNC_MUTEX_H
 
 #include "common/common.h"
-#include "sync/yieldlock.h"
-#include "utils/linked_list.h"
+#include "sync/wait_queue.h"
 
-// Mutex is a blocking lock. If thread can not acquire lock, it adds itself to mutex's waiting
-// queue and wait for the lock releaser to wake up it.
+// Mutex is a blocking lock. If thread can not acquire lock, it sleeps on mutex's wait queue
+// until the lock releaser wakes it up.
 struct mutex {
   volatile uint32 hold;
-  volatile struct linked_list_node* thread_node;
-  linked_list_t waiting_task_queue;
-  yieldlock_t ydlock;
+  wait_queue_t wait_queue;
 };
 typedef struct mutex mutex_t;
 
@@ -0,0 +1,127 @@
+#include "sync/wait_queue.h"
+#include "interrupt/timer.h"
+#include "task/thread.h"
+#include "task/scheduler.h"
+
+void wait_queue_init(wait_queue_t* wq) {
+  linked_list_init(&wq->waiters);
+  spinlock_init(&wq->lock);
+}
+
+// Queue current thread and mark it blocked. wq lock must be held, and caller yields after
+// releasing it.
+static void add_crt_waiter(wait_queue_t* wq) {
+  tcb_t* thread = get_crt_thread();
+  linked_list_append(&wq->waiters, &thread->wait_node);
+  thread->wait_queue = wq;
+  schedule_mark_thread_block();
+}
+
+// wq lock must be held.
+static tcb_t* remove_waiter(wait_queue_t* wq, thread_node_t* node) {
+  tcb_t* thread = (tcb_t*)node->ptr;
+  linked_list_remove(&wq->waiters, node);
+  thread->wait_queue = nullptr;
+  return thread;
+}
+
+void wait_event(wait_queue_t* wq, wait_condition_func condition, void* arg) {
+  while (true) {
+    spinlock_lock_irqsave(&wq->lock);
+    if (condition(arg)) {
+      spinlock_unlock_irqrestore(&wq->lock);
+      return;
+    }
+    add_crt_waiter(wq);
+    spinlock_unlock_irqrestore(&wq->lock);
+    schedule_thread_yield();
+  }
+}
+
+// Timer callback, in interrupt context.
+static void wait_timeout(void* arg) {
+  tcb_t* thread = (tcb_t*)arg;
+  thread->wait_timed_out = true;
+
+  wait_queue_t* wq = thread->wait_queue;
+  if (wq == nullptr) {
+    // Not asleep yet, it will see the timeout flag.
+    return;
+  }
+  spinlock_lock_irqsave(&wq->lock);
+  remove_waiter(wq, &thread->wait_node);
+  spinlock_unlock_irqrestore(&wq->lock);
+  add_thread_to_schedule(thread);
+}
+
+bool wait_event_timeout(
+    wait_queue_t* wq, wait_condition_func condition, void* arg, uint32 timeout_ms) {
+  tcb_t* thread = get_crt_thread();
+  thread->wait_timed_out = false;
+  timer_event_t timer;
+  timer_add(&timer, timeout_ms, wait_timeout, thread);
+
+  bool result;
+  while (true) {
+    spinlock_lock_irqsave(&wq->lock);
+    if (condition(arg)) {
+      result = true;
+      spinlock_unlock_irqrestore(&wq->lock);
+      break;
+    }
+    if (thread->wait_timed_out) {
+      result = false;
+      spinlock_unlock_irqrestore(&wq->lock);
+      break;
+    }
+    add_crt_waiter(wq);
+    spinlock_unlock_irqrestore(&wq->lock);
+    schedule_thread_yield();
+  }
+
+  timer_cancel(&timer);
+  return result;
+}
+
+void wait_queue_sleep(wait_queue_t* wq, yieldlock_t* lock) {
+  spinlock_lock_irqsave(&wq->lock);
+  add_crt_waiter(wq);
+  spinlock_unlock_irqrestore(&wq->lock);
+  yieldlock_unlock(lock);
+  schedule_thread_yield();
+
+  yieldlock_lock(lock);
+}
+
+void wake_up_one(wait_queue_t* wq) {
+  spinlock_lock_irqsave(&wq->lock);
+  tcb_t* thread = nullptr;
+  if (wq->waiters.size > 0) {
+    thread = remove_waiter(wq, wq->waiters.head);
+  }
+  spinlock_unlock_irqrestore(&wq->lock);
+
+  if (thread != nullptr) {
+    add_thread_to_schedule(thread);
+  }
+}
+
+void wake_up_all(wait_queue_t* wq) {
+  spinlock_lock_irqsave(&wq->lock);
+  linked_list_t waiters;
+  linked_list_move(&waiters, &wq->waiters);
+  thread_node_t* node = waiters.head;
+  while (node != nullptr) {
+    ((tcb_t*)node->ptr)->wait_queue = nullptr;
+    node = node->next;
+  }
+  spinlock_unlock_irqrestore(&wq->lock);
+
+  // Waiters are detached from wq now, so their wait nodes are free to be re-used.
+  node = waiters.head;
+  while (node != nullptr) {
+    thread_node_t* next_node = node->next;
+    add_thread_to_schedule((tcb_t*)node->ptr);
+    node = next_node;
+  }
+}
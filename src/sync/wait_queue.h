@@ -0,0 +1,41 @@
+#ifndef SYNC_WAIT_QUEUE_H
+#define SYNC_WAIT_QUEUE_H
+
+#include "common/common.h"
+#include "sync/spinlock.h"
+#include "sync/yieldlock.h"
+#include "utils/linked_list.h"
+
+// Wait queue of blocked threads. A waiter checks its condition and queues itself atomically
+// under the queue lock, and a waker changes the condition before taking the queue lock, so
+// wakeups can not get lost in between.
+//
+// The lock disables interrupt, so wake_up_* can be called in interrupt context.
+struct wait_queue {
+  linked_list_t waiters;
+  spinlock_t lock;
+};
+typedef struct wait_queue wait_queue_t;
+
+// Evaluated with interrupt disabled, so it must be short and never block.
+typedef bool (*wait_condition_func)(void* arg);
+
+
+// ****************************************************************************
+void wait_queue_init(wait_queue_t* wq);
+
+// Block current thread until condition(arg) is true.
+void wait_event(wait_queue_t* wq, wait_condition_func condition, void* arg);
+
+// Same as wait_event, but give up after timeout_ms. Returns true if condition is met.
+bool wait_event_timeout(
+    wait_queue_t* wq, wait_condition_func condition, void* arg, uint32 timeout_ms);
+
+// Sleep once on wq, with lock (held by caller) released while sleeping and re-acquired before
+// return. Condition protected by lock should be re-checked by caller.
+void wait_queue_sleep(wait_queue_t* wq, yieldlock_t* lock);
+
+void wake_up_one(wait_queue_t* wq);
+void wake_up_all(wait_queue_t* wq);
+
+#endif
@@ -1,6 +1,20 @@
 #ifndef SYSCALL_COMMON_H
 #define SYSCALL_COMMON_H
 
-#define 
+#include "common/common.h"
+
+// Types shared by kernel syscall implementation and user programs.
+
+// Latency histogram has log2 buckets of TSC cycles: bucket i counts calls which took
+// [2^i, 2^(i+1)) cycles.
+#define SYSCALL_LATENCY_BUCKETS  32
+#define SYSCALL_NAME_LEN         16
+
+struct syscall_stat {
+  char name[SYSCALL_NAME_LEN];
+  uint32 calls;
+  uint32 latency_hist[SYSCALL_LATENCY_BUCKETS];
+};
+typedef struct syscall_stat syscall_stat_t;
 
 #endif
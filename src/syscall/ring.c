@@ -0,0 +1,75 @@
+#include "common/stdlib.h"
+#include "common/errno.h"
+#include "mem/paging.h"
+#include "task/thread.h"
+#include "task/process.h"
+#include "task/scheduler.h"
+#include "syscall/ring.h"
+#include "syscall/syscall_impl.h"
+
+// Returns the user address of ring page.
+int32 process_ring_setup() {
+  pcb_t* process = get_crt_thread()->process;
+  if (!process->ring_enabled) {
+    map_page(SYSCALL_RING_VADDR);
+    memset((void*)SYSCALL_RING_VADDR, 0, sizeof(syscall_ring_t));
+    process->ring_enabled = true;
+  }
+  return SYSCALL_RING_VADDR;
+}
+
+// Syscalls which never return, or need the full interrupt frame, can not be batched.
+static bool ring_op_allowed(uint32 opcode) {
+  switch (opcode) {
+    case SYSCALL_EXIT_NUM:
+    case SYSCALL_FORK_NUM:
+    case SYSCALL_EXEC_NUM:
+    case SYSCALL_THREAD_EXIT_NUM:
+    case SYSCALL_RING_SETUP_NUM:
+    case SYSCALL_RING_ENTER_NUM:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// Run up to to_submit queued entries. It stops early if submission ring is empty or
+// completion ring is full. Returns the number of entries consumed.
+int32 process_ring_enter(uint32 to_submit) {
+  pcb_t* process = get_crt_thread()->process;
+  if (!process->ring_enabled) {
+    return -EINVAL;
+  }
+
+  // Ring is writable by user, so every entry is copied before use, and indexes are only
+  // trusted modulo ring size.
+  syscall_ring_t* ring = (syscall_ring_t*)SYSCALL_RING_VADDR;
+  uint32 submitted = 0;
+  while (submitted < to_submit) {
+    uint32 sq_head = ring->sq_head;
+    if (sq_head == ring->sq_tail) {
+      break;
+    }
+    uint32 cq_tail = ring->cq_tail;
+    if (cq_tail - ring->cq_head >= RING_CQ_ENTRIES) {
+      break;
+    }
+
+    ring_sqe_t sqe;
+    memcpy(&sqe, &ring->sq[sq_head % RING_SQ_ENTRIES], sizeof(ring_sqe_t));
+    ring->sq_head = sq_head + 1;
+
+    int32 result = -EINVAL;
+    if (ring_op_allowed(sqe.opcode)) {
+      result = syscall_dispatch(sqe.opcode, sqe.args[0], sqe.args[1], sqe.args[2],
+                                sqe.args[3], 0);
+    }
+
+    ring_cqe_t* cqe = &ring->cq[cq_tail % RING_CQ_ENTRIES];
+    cqe->user_data = sqe.user_data;
+    cqe->result = result;
+    ring->cq_tail = cq_tail + 1;
+    submitted++;
+  }
+  return submitted;
+}
@@ -0,0 +1,50 @@
+#ifndef SYSCALL_RING_H
+#define SYSCALL_RING_H
+
+#include "common/common.h"
+
+// Submission/completion ring shared by a user process and kernel, for batching syscalls.
+// User space queues submission entries and advances sq_tail, then a single ring_enter
+// syscall runs them IN ORDER, and posts a completion entry with the return value of each.
+// So an entry may depend on the effect of earlier ones in the same batch, e.g. read a file
+// then print the buffer.
+//
+// The ring page is mapped read-write at SYSCALL_RING_VADDR by ring_setup. This header is
+// shared with user programs.
+#define SYSCALL_RING_VADDR   0xBFFFD000
+#define RING_SQ_ENTRIES      64
+#define RING_CQ_ENTRIES      128
+
+struct ring_sqe {
+  // syscall number
+  uint32 opcode;
+  uint32 args[4];
+  // copied to completion entry
+  uint32 user_data;
+};
+typedef struct ring_sqe ring_sqe_t;
+
+struct ring_cqe {
+  uint32 user_data;
+  int32 result;
+};
+typedef struct ring_cqe ring_cqe_t;
+
+// Indexes are free running, an entry is at index % ENTRIES.
+struct syscall_ring {
+  volatile uint32 sq_head;  // advanced by kernel
+  volatile uint32 sq_tail;  // advanced by user
+  volatile uint32 cq_head;  // advanced by user
+  volatile uint32 cq_tail;  // advanced by kernel
+  ring_sqe_t sq[RING_SQ_ENTRIES];
+  ring_cqe_t cq[RING_CQ_ENTRIES];
+};
+typedef struct syscall_ring syscall_ring_t;
+
+
+// ****************************************************************************
+// Kernel side, for current process.
+int32 process_ring_setup();
+int32 process_ring_enter(uint32 to_submit);
+
+#endif
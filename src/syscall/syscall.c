@@ -5,8 +5,8 @@ extern void trigger_syscall_exit(int32 exit_code);
 extern int32 trigger_syscall_fork();
 extern int32 trigger_syscall_exec(char* path, uint32 argc, char* argv[]);
 extern void trigger_syscall_yield();
-extern int32 trigger_syscall_read(char* filename, char* buffer, uint32 offset, uint32 size);
-extern int32 trigger_syscall_write(char* filename, char* buffer, uint32 offset, uint32 size);
+extern int32 trigger_syscall_read(int32 fd, char* buffer, uint32 size);
+extern int32 trigger_syscall_write(int32 fd, char* buffer, uint32 size);
 extern int32 trigger_syscall_stat(char* filename, file_stat_t* stat);
 extern int32 trigger_syscall_listdir(char* dir);
 extern void trigger_syscall_print(char* str, void* args);
@@ -14,6 +14,20 @@ extern int32 trigger_syscall_wait(uint32 pid, uint32* status);
 extern int32 trigger_syscall_thread_exit();
 extern int32 trigger_syscall_read_char();
 extern void trigger_syscall_move_cursor(int32 delta_x, int32 delta_y);
+extern int32 trigger_syscall_set_priority(uint32 tid, uint32 priority);
+extern int32 trigger_syscall_list_process();
+extern int32 trigger_syscall_sleep_ms(uint32 ms);
+extern int32 trigger_syscall_clock_gettime(timespec_t* ts);
+extern int32 trigger_syscall_getpid();
+extern int32 trigger_syscall_int_getpid();
+extern int32 trigger_syscall_syscall_stats(syscall_stat_t* stats, uint32 num);
+extern int32 trigger_syscall_ring_setup();
+extern int32 trigger_syscall_ring_enter(uint32 to_submit);
+extern int32 trigger_syscall_open(char* path, uint32 flags);
+extern int32 trigger_syscall_close(int32 fd);
+extern int32 trigger_syscall_lseek(int32 fd, int32 offset, uint32 whence);
+extern int32 trigger_syscall_fstat(int32 fd, file_stat_t* stat);
+extern int32 trigger_syscall_sync();
 
 
 void exit(int32 exit_code) {
@@ -32,12 +46,12 @@ void yield() {
   trigger_syscall_yield();
 }
 
-int32 read(char* filename, char* buffer, uint32 offset, uint32 size) {
-  return trigger_syscall_read(filename, buffer, offset, size);
+int32 read(int32 fd, char* buffer, uint32 size) {
+  return trigger_syscall_read(fd, buffer, size);
 }
 
-int32 write(char* filename, char* buffer, uint32 offset, uint32 size) {
-  return trigger_syscall_write(filename, buffer, offset, size);
+int32 write(int32 fd, char* buffer, uint32 size) {
+  return trigger_syscall_write(fd, buffer, size);
 }
 
 int32 stat(char* filename, file_stat_t* stat) {
@@ -67,3 +81,59 @@ int32 read_char() {
 void move_cursor(int32 delta_x, int32 delta_y) {
   trigger_syscall_move_cursor(delta_x, delta_y);
 }
+
+int32 set_priority(uint32 tid, uint32 priority) {
+  return trigger_syscall_set_priority(tid, priority);
+}
+
+int32 list_process() {
+  return trigger_syscall_list_process();
+}
+
+int32 sleep_ms(uint32 ms) {
+  return trigger_syscall_sleep_ms(ms);
+}
+
+int32 clock_gettime(timespec_t* ts) {
+  return trigger_syscall_clock_gettime(ts);
+}
+
+int32 getpid() {
+  return trigger_syscall_getpid();
+}
+
+int32 getpid_int() {
+  return trigger_syscall_int_getpid();
+}
+
+int32 syscall_stats(syscall_stat_t* stats, uint32 num) {
+  return trigger_syscall_syscall_stats(stats, num);
+}
+
+int32 ring_setup() {
+  return trigger_syscall_ring_setup();
+}
+
+int32 ring_enter(uint32 to_submit) {
+  return trigger_syscall_ring_enter(to_submit);
+}
+
+int32 open(char* path, uint32 flags) {
+  return trigger_syscall_open(path, flags);
+}
+
+int32 close(int32 fd) {
+  return trigger_syscall_close(fd);
+}
+
+int32 lseek(int32 fd, int32 offset, uint32 whence) {
+  return trigger_syscall_lseek(fd, offset, whence);
+}
+
+int32 fstat(int32 fd, file_stat_t* stat) {
+  return trigger_syscall_fstat(fd, stat);
+}
+
+int32 sync() {
+  return trigger_syscall_sync();
+}
@@ -3,6 +3,8 @@
 
 #include "common/common.h"
 #include "fs/file.h"
+#include "interrupt/clock.h"
+#include "syscall/common.h"
 
 void exit(int32 exit_code);
 
@@ -12,9 +14,10 @@ int32 exec(char* path, uint32 argc, char* argv[]);
 
 void yield();
 
-int32 read(char* filename, char* buffer, uint32 offset, uint32 size);
+// Read and write at the current offset of fd, and advance it.
+int32 read(int32 fd, char* buffer, uint32 size);
 
-int32 write(char* filename, char* buffer, uint32 offset, uint32 size);
+int32 write(int32 fd, char* buffer, uint32 size);
 
 int32 stat(char* filename, file_stat_t* stat);
 
@@ -30,4 +33,44 @@ int32 read_char();
 
 void move_cursor(int32 delta_x, int32 delta_y);
 
+// Set priority of thread tid in current process; tid 0 means current thread.
+int32 set_priority(uint32 tid, uint32 priority);
+
+// Print pid, threads, cpu ticks and cpu share of all processes.
+int32 list_process();
+
+// Block current thread for ms milliseconds.
+int32 sleep_ms(uint32 ms);
+
+// Get monotonic time since boot, in nanosecond resolution.
+int32 clock_gettime(timespec_t* ts);
+
+int32 getpid();
+
+// Same as getpid, but always enters kernel by int 0x80, for comparing with SYSENTER.
+int32 getpid_int();
+
+// Copy call counts and latency histograms of the first num syscalls, indexed by syscall
+// number. Returns the number of entries copied.
+int32 syscall_stats(syscall_stat_t* stats, uint32 num);
+
+// Map syscall ring (see syscall/ring.h) for current process and return its address.
+int32 ring_setup();
+
+// Run up to to_submit queued ring entries, and return the number consumed.
+int32 ring_enter(uint32 to_submit);
+
+// Open file and return the lowest free fd, or negative errno.
+int32 open(char* path, uint32 flags);
+
+int32 close(int32 fd);
+
+// Set fd offset by whence (SEEK_SET, SEEK_CUR, SEEK_END), and return the new offset.
+int32 lseek(int32 fd, int32 offset, uint32 whence);
+
+int32 fstat(int32 fd, file_stat_t* stat);
+
+// Write all cached file data to disk, and wait until it's durable.
+int32 sync();
+
 #endif
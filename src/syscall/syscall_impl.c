@@ -1,6 +1,9 @@
 #include "common/stdlib.h"
+#include "common/errno.h"
 #include "monitor/monitor.h"
 #include "interrupt/interrupt.h"
+#include "interrupt/timer.h"
+#include "interrupt/clock.h"
 #include "mem/paging.h"
 #include "mem/kheap.h"
 #include "task/thread.h"
@@ -10,7 +13,23 @@
 #include "task/process.h"
 #include "task/scheduler.h"
 #include "syscall/syscall_impl.h"
+#include "syscall/ring.h"
 #include "utils/debug.h"
+#include "utils/math.h"
+
+extern uint32 atomic_add(volatile uint32* dst, uint32 delta);
+
+typedef int32 (*syscall_func_t)(uint32, uint32, uint32, uint32, uint32);
+
+struct syscall_entry {
+  char* name;
+  syscall_func_t func;
+  volatile uint32 calls;
+  volatile uint32 latency_hist[SYSCALL_LATENCY_BUCKETS];
+};
+typedef struct syscall_entry syscall_entry_t;
+
+static syscall_entry_t syscall_table[SYSCALL_NUM];
 
 static int32 syscall_exit_impl(int32 exit_code) {
   process_exit(exit_code);
@@ -25,15 +44,30 @@ static int32 syscall_exec_impl(char* path, uint32 argc, char* argv[]) {
 }
 
 static int32 syscall_yield_impl() {
+  schedule_thread_yield();
   return 0;
 }
 
-static int32 syscall_read_impl(char* filename, char* buffer, uint32 offset, uint32 size) {
-  return read_file(filename, buffer, offset, size);
+static int32 syscall_read_impl(int32 fd, char* buffer, uint32 size) {
+  pcb_t* process = get_crt_thread()->process;
+  file_t* file = process_get_file(process, fd);
+  if (file == nullptr) {
+    return -EBADF;
+  }
+  int32 ret = read_opened_file(file, buffer, size);
+  close_file(file);
+  return ret;
 }
 
-static int32 syscall_write_impl(char* filename, char* buffer, uint32 offset, uint32 size) {
-  return -1;
+static int32 syscall_write_impl(int32 fd, char* buffer, uint32 size) {
+  pcb_t* process = get_crt_thread()->process;
+  file_t* file = process_get_file(process, fd);
+  if (file == nullptr) {
+    return -EBADF;
+  }
+  int32 ret = write_opened_file(file, buffer, size);
+  close_file(file);
+  return ret;
 }
 
 static int32 syscall_stat_impl(char* filename, file_stat_t* stat) {
@@ -67,41 +101,185 @@ static int32 syscall_move_cursor_impl(int32 delta_x, int32 delta_y) {
   return 0;
 }
 
+static int32 syscall_set_priority_impl(uint32 tid, uint32 priority) {
+  tcb_t* crt_thread = get_crt_thread();
+  if (tid == 0 || tid == crt_thread->id) {
+    return schedule_set_thread_priority(crt_thread, priority);
+  }
+
+  pcb_t* process = crt_thread->process;
+  yieldlock_lock(&process->lock);
+  tcb_t* thread = hash_table_get(&process->threads, tid);
+  int32 ret = -1;
+  if (thread != nullptr) {
+    ret = schedule_set_thread_priority(thread, priority);
+  }
+  yieldlock_unlock(&process->lock);
+  return ret;
+}
+
+static int32 syscall_list_process_impl() {
+  return list_processes();
+}
+
+static int32 syscall_sleep_ms_impl(uint32 ms) {
+  timer_sleep_ms(ms);
+  return 0;
+}
+
+static int32 syscall_clock_gettime_impl(timespec_t* ts) {
+  clock_gettime_monotonic(ts);
+  return 0;
+}
+
+static int32 syscall_getpid_impl() {
+  return get_crt_thread()->process->id;
+}
+
+static int32 syscall_stats_impl(syscall_stat_t* stats, uint32 num) {
+  num = min(num, SYSCALL_NUM);
+  for (uint32 i = 0; i < num; i++) {
+    syscall_entry_t* entry = &syscall_table[i];
+    memset(&stats[i], 0, sizeof(syscall_stat_t));
+    if (entry->name != nullptr) {
+      strcpy(stats[i].name, entry->name);
+    }
+    stats[i].calls = entry->calls;
+    memcpy(stats[i].latency_hist, (void*)entry->latency_hist, sizeof(entry->latency_hist));
+  }
+  return num;
+}
+
+static int32 syscall_open_impl(char* path, uint32 flags) {
+  file_t* file = open_file(path, flags);
+  if (file == nullptr) {
+    return -ENOENT;
+  }
+  int32 fd = process_install_file(get_crt_thread()->process, file);
+  if (fd < 0) {
+    close_file(file);
+  }
+  return fd;
+}
+
+static int32 syscall_close_impl(int32 fd) {
+  file_t* file = process_remove_file(get_crt_thread()->process, fd);
+  if (file == nullptr) {
+    return -EBADF;
+  }
+  close_file(file);
+  return 0;
+}
+
+static int32 syscall_lseek_impl(int32 fd, int32 offset, uint32 whence) {
+  file_t* file = process_get_file(get_crt_thread()->process, fd);
+  if (file == nullptr) {
+    return -EBADF;
+  }
+  int32 ret = seek_file(file, offset, whence);
+  close_file(file);
+  return ret;
+}
+
+static int32 syscall_fstat_impl(int32 fd, file_stat_t* stat) {
+  file_t* file = process_get_file(get_crt_thread()->process, fd);
+  if (file == nullptr) {
+    return -EBADF;
+  }
+  stat_opened_file(file, stat);
+  close_file(file);
+  return 0;
+}
+
+static int32 syscall_sync_impl() {
+  return sync_file_system() == 0 ? 0 : -EIO;
+}
+
+static int32 syscall_ring_setup_impl() {
+  return process_ring_setup();
+}
+
+static int32 syscall_ring_enter_impl(uint32 to_submit) {
+  return process_ring_enter(to_submit);
+}
+
+#define SYSCALL_ENTRY(num, name, func)  [num] = { name, (syscall_func_t)func, 0, {0} }
+
+static syscall_entry_t syscall_table[SYSCALL_NUM] = {
+  SYSCALL_ENTRY(SYSCALL_EXIT_NUM,          "exit",          syscall_exit_impl),
+  SYSCALL_ENTRY(SYSCALL_FORK_NUM,          "fork",          syscall_fork_impl),
+  SYSCALL_ENTRY(SYSCALL_EXEC_NUM,          "exec",          syscall_exec_impl),
+  SYSCALL_ENTRY(SYSCALL_YIELD_NUM,         "yield",         syscall_yield_impl),
+  SYSCALL_ENTRY(SYSCALL_READ_NUM,          "read",          syscall_read_impl),
+  SYSCALL_ENTRY(SYSCALL_WRITE_NUM,         "write",         syscall_write_impl),
+  SYSCALL_ENTRY(SYSCALL_STAT_NUM,          "stat",          syscall_stat_impl),
+  SYSCALL_ENTRY(SYSCALL_LISTDIR_NUM,       "listdir",       syscall_listdir_impl),
+  SYSCALL_ENTRY(SYSCALL_PRINT_NUM,         "print",         syscall_print_impl),
+  SYSCALL_ENTRY(SYSCALL_WAIT_NUM,          "wait",          syscall_wait_impl),
+  SYSCALL_ENTRY(SYSCALL_THREAD_EXIT_NUM,   "thread_exit",   syscall_thread_exit_impl),
+  SYSCALL_ENTRY(SYSCALL_READ_CHAR_NUM,     "read_char",     syscall_read_char_impl),
+  SYSCALL_ENTRY(SYSCALL_MOVE_CURSOR_NUM,   "move_cursor",   syscall_move_cursor_impl),
+  SYSCALL_ENTRY(SYSCALL_SET_PRIORITY_NUM,  "set_priority",  syscall_set_priority_impl),
+  SYSCALL_ENTRY(SYSCALL_LIST_PROCESS_NUM,  "list_process",  syscall_list_process_impl),
+  SYSCALL_ENTRY(SYSCALL_SLEEP_MS_NUM,      "sleep_ms",      syscall_sleep_ms_impl),
+  SYSCALL_ENTRY(SYSCALL_CLOCK_GETTIME_NUM, "clock_gettime", syscall_clock_gettime_impl),
+  SYSCALL_ENTRY(SYSCALL_GETPID_NUM,        "getpid",        syscall_getpid_impl),
+  SYSCALL_ENTRY(SYSCALL_STATS_NUM,         "syscall_stats", syscall_stats_impl),
+  SYSCALL_ENTRY(SYSCALL_RING_SETUP_NUM,    "ring_setup",    syscall_ring_setup_impl),
+  SYSCALL_ENTRY(SYSCALL_RING_ENTER_NUM,    "ring_enter",    syscall_ring_enter_impl),
+  SYSCALL_ENTRY(SYSCALL_OPEN_NUM,          "open",          syscall_open_impl),
+  SYSCALL_ENTRY(SYSCALL_CLOSE_NUM,         "close",         syscall_close_impl),
+  SYSCALL_ENTRY(SYSCALL_LSEEK_NUM,         "lseek",         syscall_lseek_impl),
+  SYSCALL_ENTRY(SYSCALL_FSTAT_NUM,         "fstat",         syscall_fstat_impl),
+  SYSCALL_ENTRY(SYSCALL_SYNC_NUM,          "sync",          syscall_sync_impl),
+};
+
+// Log2 bucket of cycles.
+static uint32 latency_bucket(uint64 cycles) {
+  if (cycles >> 32) {
+    return SYSCALL_LATENCY_BUCKETS - 1;
+  }
+  uint32 low = (uint32)cycles;
+  if (low == 0) {
+    return 0;
+  }
+  uint32 bucket;
+  asm volatile("bsr %1, %0" : "=r"(bucket) : "r"(low));
+  return bucket;
+}
+
+// Calls are counted before running, since exit and exec never return. Latency is measured
+// in TSC cycles, including time blocked in the syscall.
+int32 syscall_dispatch(
+    uint32 syscall_num, uint32 arg1, uint32 arg2, uint32 arg3, uint32 arg4, uint32 arg5) {
+  if (syscall_num >= SYSCALL_NUM || syscall_table[syscall_num].func == nullptr) {
+    return -ENOSYS;
+  }
+  syscall_entry_t* entry = &syscall_table[syscall_num];
+  atomic_add(&entry->calls, 1);
+
+  uint64 start = clock_read_tsc();
+  int32 ret = entry->func(arg1, arg2, arg3, arg4, arg5);
+  uint64 end = clock_read_tsc();
+  if (end > start) {
+    atomic_add(&entry->latency_hist[latency_bucket(end - start)], 1);
+  }
+  return ret;
+}
+
 int32 syscall_handler(isr_params_t isr_params) {
   // syscall num saved in eax.
   // args list: ecx, edx, ebx, esi, edi
-  uint32 syscall_num = isr_params.eax;
-
-  switch (syscall_num) {
-    case SYSCALL_EXIT_NUM:
-      return syscall_exit_impl((int32)isr_params.ecx);
-    case SYSCALL_FORK_NUM:
-      return syscall_fork_impl();
-    case SYSCALL_EXEC_NUM:
-      return syscall_exec_impl((char*)isr_params.ecx, isr_params.edx, (char**)isr_params.ebx);
-    case SYSCALL_YIELD_NUM:
-      return syscall_yield_impl();
-    case SYSCALL_READ_NUM:
-      return syscall_read_impl((char*)isr_params.ecx, (char*)isr_params.edx,
-          (uint32)isr_params.ebx, (uint32)isr_params.esi);
-    case SYSCALL_WRITE_NUM:
-      return syscall_write_impl((char*)isr_params.ecx, (char*)isr_params.edx,
-          (uint32)isr_params.ebx, (uint32)isr_params.esi);
-    case SYSCALL_STAT_NUM:
-      return syscall_stat_impl((char*)isr_params.ecx, (file_stat_t*)isr_params.edx);
-    case SYSCALL_LISTDIR_NUM:
-      return syscall_listdir_impl((char*)isr_params.ecx);
-    case SYSCALL_PRINT_NUM:
-      return syscall_print_impl((char*)isr_params.ecx, (void*)isr_params.edx);
-    case SYSCALL_WAIT_NUM:
-      return syscall_wait_impl((uint32)isr_params.ecx, (uint32*)isr_params.edx);
-    case SYSCALL_THREAD_EXIT_NUM:
-      return syscall_thread_exit_impl();
-    case SYSCALL_READ_CHAR_NUM:
-      return syscall_read_char_impl();
-    case SYSCALL_MOVE_CURSOR_NUM:
-      return syscall_move_cursor_impl((int32)isr_params.ecx, (int32)isr_params.edx);
-    default:
-      PANIC();
+  return syscall_dispatch(isr_params.eax, isr_params.ecx, isr_params.edx, isr_params.ebx,
+                          isr_params.esi, isr_params.edi);
+}
+
+// SYSENTER passes user esp and return eip in ecx and edx, so args are in ebx, esi, edi, ebp
+// and at most 4 of them.
+int32 sysenter_handler(uint32 syscall_num, uint32 arg1, uint32 arg2, uint32 arg3, uint32 arg4) {
+  // Fork copies the interrupt frame for the child to return with, so it's int 0x80 only.
+  if (syscall_num == SYSCALL_FORK_NUM) {
+    return -ENOSYS;
   }
+  return syscall_dispatch(syscall_num, arg1, arg2, arg3, arg4, 0);
 }
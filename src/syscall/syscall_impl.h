@@ -3,6 +3,7 @@
 
 #include "common/common.h"
 #include "interrupt/interrupt.h"
+#include "syscall/common.h"
 
 #define SYSCALL_EXIT_NUM          0
 #define SYSCALL_FORK_NUM          1
@@ -17,9 +18,30 @@
 #define SYSCALL_THREAD_EXIT_NUM   10
 #define SYSCALL_READ_CHAR_NUM     11
 #define SYSCALL_MOVE_CURSOR_NUM   12
+#define SYSCALL_SET_PRIORITY_NUM  13
+#define SYSCALL_LIST_PROCESS_NUM  14
+#define SYSCALL_SLEEP_MS_NUM      15
+#define SYSCALL_CLOCK_GETTIME_NUM 16
+#define SYSCALL_GETPID_NUM        17
+#define SYSCALL_STATS_NUM         18
+#define SYSCALL_RING_SETUP_NUM    19
+#define SYSCALL_RING_ENTER_NUM    20
+#define SYSCALL_OPEN_NUM          21
+#define SYSCALL_CLOSE_NUM         22
+#define SYSCALL_LSEEK_NUM         23
+#define SYSCALL_FSTAT_NUM         24
+#define SYSCALL_SYNC_NUM          25
 
+#define SYSCALL_NUM               26
+
+
+// Run syscall by number. Returns -ENOSYS for unknown syscall.
+int32 syscall_dispatch(
+    uint32 syscall_num, uint32 arg1, uint32 arg2, uint32 arg3, uint32 arg4, uint32 arg5);
 
 int32 syscall_handler(isr_params_t isr_params);
 
+int32 sysenter_handler(uint32 syscall_num, uint32 arg1, uint32 arg2, uint32 arg3, uint32 arg4);
+
 
 #endif
@@ -1,10 +1,12 @@
 #include "common/stdlib.h"
+#include "common/errno.h"
 #include "task/process.h"
 #include "task/thread.h"
 #include "task/scheduler.h"
 #include "monitor/monitor.h"
 #include "mem/kheap.h"
 #include "mem/paging.h"
+#include "mem/vdso.h"
 #include "fs/file.h"
 #include "fs/vfs.h"
 #include "elf/elf.h"
@@ -53,9 +55,13 @@ pcb_t* create_process(char* name, uint8 is_kernel_process) {
 
   hash_table_init(&process->exit_children_processes);
 
-  process->waiting_child_pid = 0;
+  wait_queue_init(&process->wait_children);
 
-  process->waiting_thread_node = nullptr;
+  fair_group_init(&process->fair_group);
+  process->cpu_ticks = 0;
+
+  process->ring_enabled = false;
+  process->vdso_frame = 0;
 
   process->page_dir = clone_crt_page_dir();
   yieldlock_init(&process->page_dir_lock);
@@ -123,7 +129,46 @@ void add_child_process(pcb_t* parent, pcb_t* child) {
   yieldlock_unlock(&parent->lock);
 }
 
+int32 process_install_file(pcb_t* process, file_t* file) {
+  yieldlock_lock(&process->lock);
+  for (int32 fd = 0; fd < PROCESS_FILES_MAX; fd++) {
+    if (process->files[fd] == nullptr) {
+      process->files[fd] = file;
+      yieldlock_unlock(&process->lock);
+      return fd;
+    }
+  }
+  yieldlock_unlock(&process->lock);
+  return -EMFILE;
+}
+
+file_t* process_get_file(pcb_t* process, int32 fd) {
+  if (fd < 0 || fd >= PROCESS_FILES_MAX) {
+    return nullptr;
+  }
+  yieldlock_lock(&process->lock);
+  file_t* file = process->files[fd];
+  if (file != nullptr) {
+    dup_file(file);
+  }
+  yieldlock_unlock(&process->lock);
+  return file;
+}
+
+file_t* process_remove_file(pcb_t* process, int32 fd) {
+  if (fd < 0 || fd >= PROCESS_FILES_MAX) {
+    return nullptr;
+  }
+  yieldlock_lock(&process->lock);
+  file_t* file = process->files[fd];
+  process->files[fd] = nullptr;
+  yieldlock_unlock(&process->lock);
+  return file;
+}
+
 static void release_user_space_pages() {
+  // vDSO frames are not owned by the page tables, unmap them before releasing frames.
+  vdso_unmap();
   // User virtual space is 4MB - 3G, totally 1024 * 3/4 - 1 = 767 page dir entries.
   release_pages(4 * 1024 * 1024, 767 * 1024, true);
   release_pages_tables(1, 767);
@@ -132,11 +177,21 @@ static void release_user_space_pages() {
 int32 process_fork() {
   // Create a new process, with page directory cloned from this process.
   pcb_t* process = create_process(nullptr, /* is_kernel_process = */false);
-  add_new_process(process);
 
   pcb_t* parent_process = get_crt_thread()->process;
   process->parent = parent_process;
   add_child_process(parent_process, process);
+  // Ring page is copied as other user pages.
+  process->ring_enabled = parent_process->ring_enabled;
+
+  // Child shares opened files with parent, including their offsets.
+  yieldlock_lock(&parent_process->lock);
+  for (int32 fd = 0; fd < PROCESS_FILES_MAX; fd++) {
+    if (parent_process->files[fd] != nullptr) {
+      process->files[fd] = dup_file(parent_process->files[fd]);
+    }
+  }
+  yieldlock_unlock(&parent_process->lock);
 
   // Copy current thread and prepare for its kernel and user stacks.
   tcb_t* thread = fork_crt_thread();
@@ -198,6 +253,7 @@ int32 process_exec(char* path, uint32 argc, char* argv[]) {
 
   // Release all user space pages of this process.
   release_user_space_pages();
+  process->ring_enabled = false;
 
   // Load elf binary.
   uint32 exec_entry;
@@ -223,8 +279,7 @@ int32 process_exec(char* path, uint32 argc, char* argv[]) {
 
 // Process wait
 int32 process_wait(uint32 pid, uint32* status) {
-  thread_node_t* thread_node = get_crt_thread_node();
-  tcb_t* thread = (tcb_t*)thread_node->ptr;
+  tcb_t* thread = get_crt_thread();
   pcb_t* process = thread->process;
 
   yieldlock_lock(&process->lock);
@@ -234,9 +289,6 @@ int32 process_wait(uint32 pid, uint32* status) {
     return -1;
   }
 
-  // If wait for any child, set parent's waiting_child_pid as pid of itself.
-  process->waiting_child_pid = (pid > 0 ? pid : process->id);
-
   // Wait for child.
   pcb_t* child = nullptr;
   while (true) {
@@ -256,12 +308,8 @@ int32 process_wait(uint32 pid, uint32* status) {
       }
     }
 
-    process->waiting_thread_node = thread_node;
-    schedule_mark_thread_block();
-    yieldlock_unlock(&process->lock);
-    schedule_thread_yield();
-
-    yieldlock_lock(&process->lock);
+    // Children exit under process lock, so no exit can be missed while going to sleep.
+    wait_queue_sleep(&process->wait_children, &process->lock);
   }
 
   // Reap child exit code and release pcb struct.
@@ -282,8 +330,7 @@ int32 process_wait(uint32 pid, uint32* status) {
 //  - If parent is waiting, wake it up and set exit status;
 //  - release all resources (except pcb);
 void process_exit(int32 exit_code) {
-  thread_node_t* thread_node = get_crt_thread_node();
-  tcb_t* thread = (tcb_t*)thread_node->ptr;
+  tcb_t* thread = get_crt_thread();
   pcb_t* process = thread->process;
   pcb_t* parent = process->parent;
 
@@ -317,11 +364,8 @@ void process_exit(int32 exit_code) {
   // Add to parent's exit_children_processes, and maybe wake up parent.
   yieldlock_lock(&parent->lock);
   hash_table_put(&parent->exit_children_processes, process->id, process);
-  // Notify parent, if it is waiting for this child, or waiting for any child.
-  if (parent->waiting_child_pid == process->id || parent->waiting_child_pid == parent->id) {
-    //monitor_printf("wake up parent %d\n", ((tcb_t*)(parent->waiting_thread_node->ptr))->id);
-    add_thread_node_to_schedule(parent->waiting_thread_node);
-  }
+  // Wake up parent threads waiting for children, each of them checks its own pid.
+  wake_up_all(&parent->wait_children);
   yieldlock_unlock(&parent->lock);
 
   schedule_thread_exit();
@@ -334,15 +378,27 @@ void release_process_resources(pcb_t* process) {
   hash_table_clear(&process->threads);
   hash_table_destroy(&process->exit_children_processes);
 
+  for (int32 fd = 0; fd < PROCESS_FILES_MAX; fd++) {
+    if (process->files[fd] != nullptr) {
+      close_file(process->files[fd]);
+      process->files[fd] = nullptr;
+    }
+  }
+
   release_user_space_pages();
 }
 
 // The final step of destroying a process:
-//  - Release page directory frame;
+//  - Remove it from processes map;
+//  - Release page directory and vDSO frames;
 //  - Return pid;
 //  - Release process struct;
 void destroy_process(pcb_t* process) {
+  remove_process(process);
   release_phy_frame(process->page_dir.page_dir_entries_phy);
+  if (process->vdso_frame > 0) {
+    release_phy_frame(process->vdso_frame);
+  }
   id_pool_free_id(&process_id_pool, process->id);
   kfree(process);
 }
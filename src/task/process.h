@@ -2,8 +2,11 @@
 #define TASK_PROCESS_H
 
 #include "task/thread.h"
+#include "task/sched_fair.h"
 #include "mem/paging.h"
+#include "fs/vfs.h"
 #include "sync/mutex.h"
+#include "sync/wait_queue.h"
 #include "sync/yieldlock.h"
 #include "utils/bitmap.h"
 #include "utils/linked_list.h"
@@ -12,6 +15,7 @@
 #define USER_STACK_TOP   0xBFC00000  // 0xC0000000 - 4MB
 #define USER_STACK_SIZE  65536       // 64KB
 #define USER_PRCOESS_THREDS_MAX  4096
+#define PROCESS_FILES_MAX  32
 
 enum process_status {
   PROCESS_NORMAL,
@@ -45,11 +49,23 @@ struct process_struct {
   // exit children processes
   hash_table_t exit_children_processes;
 
-  // child pid that is waiting
-  uint32 waiting_child_pid;
+  // threads waiting for children to exit
+  wait_queue_t wait_children;
 
-  // waiting thread
-  struct linked_list_node* waiting_thread_node;
+  // fair scheduling group of all threads in this process
+  fair_group_t fair_group;
+
+  // timer ticks all threads of this process have been running for
+  uint32 cpu_ticks;
+
+  // opened files, indexed by fd
+  file_t* files[PROCESS_FILES_MAX];
+
+  // syscall ring page is mapped
+  bool ring_enabled;
+
+  // vDSO process page frame, allocated on first access
+  uint32 vdso_frame;
 
   // page directory
   page_directory_t page_dir;
@@ -75,6 +91,14 @@ void remove_process_thread(pcb_t* process, struct task_struct* thread);
 
 void add_child_process(pcb_t* parent, pcb_t* child);
 
+// Install file at the lowest free fd. Returns the fd, or -EMFILE if fd table is full.
+int32 process_install_file(pcb_t* process, file_t* file);
+// Get the file of fd with a reference held, which must be dropped by close_file.
+// Returns nullptr if fd is not open.
+file_t* process_get_file(pcb_t* process, int32 fd);
+// Remove fd from fd table, and return its file. Returns nullptr if fd is not open.
+file_t* process_remove_file(pcb_t* process, int32 fd);
+
 void release_process_resources(pcb_t* process);
 void destroy_process(pcb_t* process);
 
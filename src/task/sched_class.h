@@ -0,0 +1,46 @@
+#ifndef TASK_SCHED_CLASS_H
+#define TASK_SCHED_CLASS_H
+
+#include "common/common.h"
+#include "task/thread.h"
+
+// Enqueue flags.
+#define ENQUEUE_HEAD    (1 << 0)  // run this thread as early as the policy allows
+#define ENQUEUE_WAKEUP  (1 << 1)  // thread is waking up from blocking
+
+typedef void (*sched_init_func)();
+typedef void (*sched_enqueue_func)(thread_node_t* thread_node, uint32 flags);
+typedef thread_node_t* (*sched_pick_next_func)();
+typedef uint32 (*sched_ready_num_func)();
+typedef bool (*sched_check_preempt_tick_func)(tcb_t* crt_thread);
+typedef bool (*sched_check_preempt_wakeup_func)(tcb_t* crt_thread, tcb_t* woken_thread);
+typedef bool (*sched_tick_func)(tcb_t* crt_thread);
+
+// A scheduling class decides how ready threads are queued and which one runs next.
+// The scheduler core handles the cpu idle thread itself, so it is never passed in here.
+// All functions are called with interrupt DISABLED.
+struct sched_class {
+  char* name;
+
+  // functions
+  sched_init_func init;
+  // Queue a ready thread.
+  sched_enqueue_func enqueue;
+  // Dequeue the next thread to run. Only called when ready_num() > 0.
+  sched_pick_next_func pick_next;
+  sched_ready_num_func ready_num;
+  // Whether current thread, with its time slice used up, should give cpu to a ready thread.
+  sched_check_preempt_tick_func check_preempt_tick;
+  // Whether a newly woken thread should preempt current thread.
+  sched_check_preempt_wakeup_func check_preempt_wakeup;
+  // Timer tick accounting. Returns true if current thread has used up its time slice.
+  sched_tick_func tick;
+};
+typedef struct sched_class sched_class_t;
+
+
+// ****************************************************************************
+sched_class_t* get_priority_sched_class();
+sched_class_t* get_fair_sched_class();
+
+#endif
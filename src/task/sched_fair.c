@@ -0,0 +1,189 @@
+#include "task/thread.h"
+#include "task/process.h"
+#include "task/sched_class.h"
+#include "task/sched_fair.h"
+#include "interrupt/timer.h"
+#include "utils/rb_tree.h"
+
+// Weights of nice -20 .. 19, each level is ~1.25x cpu time of the next one.
+static const uint32 nice_to_weight[40] = {
+  /* -20 */ 88761, 71755, 56483, 46273, 36291,
+  /* -15 */ 29154, 23254, 18705, 14949, 11916,
+  /* -10 */  9548,  7620,  6100,  4904,  3906,
+  /*  -5 */  3121,  2501,  1991,  1586,  1277,
+  /*   0 */  1024,   820,   655,   526,   423,
+  /*   5 */   335,   272,   215,   172,   137,
+  /*  10 */   110,    87,    70,    56,    45,
+  /*  15 */    36,    29,    23,    18,    15,
+};
+
+// groups which have ready threads, ordered by group vruntime
+static rb_tree_t ready_groups;
+static uint64 min_vruntime = 0;
+static uint32 ready_threads_num = 0;
+
+// for threads which have been detached from process
+static fair_group_t orphan_group;
+
+static int32 compare_vruntime(uint64 a, uint64 b) {
+  return a < b ? -1 : (a == b ? 0 : 1);
+}
+
+static int32 group_comparator(rb_node_t* a, rb_node_t* b) {
+  return compare_vruntime(container_of(a, fair_group_t, rb_node)->vruntime,
+                          container_of(b, fair_group_t, rb_node)->vruntime);
+}
+
+static int32 entity_comparator(rb_node_t* a, rb_node_t* b) {
+  return compare_vruntime(container_of(a, fair_entity_t, rb_node)->vruntime,
+                          container_of(b, fair_entity_t, rb_node)->vruntime);
+}
+
+static uint64 max_vruntime(uint64 a, uint64 b) {
+  return a > b ? a : b;
+}
+
+// Place an entity no further than FAIR_WAKEUP_CREDIT behind min vruntime.
+static uint64 place_vruntime(uint64 vruntime, uint64 min) {
+  if (min > FAIR_WAKEUP_CREDIT) {
+    return max_vruntime(vruntime, min - FAIR_WAKEUP_CREDIT);
+  }
+  return vruntime;
+}
+
+// Thread priority maps to nice: default priority is nice 0, and each level above it is one
+// nice level higher in weight.
+static uint32 thread_weight(tcb_t* thread) {
+  int32 nice = (int32)THREAD_DEFAULT_PRIORITY - (int32)thread->priority;
+  if (nice < -20) {
+    nice = -20;
+  } else if (nice > 19) {
+    nice = 19;
+  }
+  return nice_to_weight[nice + 20];
+}
+
+static fair_group_t* thread_group(tcb_t* thread) {
+  if (thread->process == nullptr) {
+    return &orphan_group;
+  }
+  return &thread->process->fair_group;
+}
+
+static fair_group_t* first_group() {
+  return container_of(rb_tree_first(&ready_groups), fair_group_t, rb_node);
+}
+
+static fair_entity_t* first_entity(fair_group_t* group) {
+  return container_of(rb_tree_first(&group->ready_threads), fair_entity_t, rb_node);
+}
+
+void fair_group_init(fair_group_t* group) {
+  group->vruntime = 0;
+  group->min_vruntime = 0;
+  rb_tree_init(&group->ready_threads, entity_comparator);
+  group->on_rq = false;
+}
+
+static void fair_init() {
+  rb_tree_init(&ready_groups, group_comparator);
+  min_vruntime = 0;
+  ready_threads_num = 0;
+  fair_group_init(&orphan_group);
+}
+
+static void fair_enqueue(thread_node_t* thread_node, uint32 flags) {
+  tcb_t* thread = (tcb_t*)thread_node->ptr;
+  fair_entity_t* entity = &thread->fair;
+  fair_group_t* group = thread_group(thread);
+  entity->thread_node = thread_node;
+
+  // New and waking threads are placed near min_vruntime. A preempted thread has already
+  // caught up with min_vruntime, so this is no-op for it.
+  entity->vruntime = place_vruntime(entity->vruntime, group->min_vruntime);
+  if ((flags & ENQUEUE_HEAD) && group->ready_threads.size > 0) {
+    uint64 first_vruntime = first_entity(group)->vruntime;
+    if (entity->vruntime > first_vruntime) {
+      entity->vruntime = first_vruntime;
+    }
+  }
+  rb_tree_insert(&group->ready_threads, &entity->rb_node);
+
+  if (!group->on_rq) {
+    group->vruntime = place_vruntime(group->vruntime, min_vruntime);
+    rb_tree_insert(&ready_groups, &group->rb_node);
+    group->on_rq = true;
+  }
+  ready_threads_num++;
+}
+
+// Pick the thread with minimum vruntime, from the group with minimum vruntime.
+static thread_node_t* fair_pick_next() {
+  fair_group_t* group = first_group();
+  min_vruntime = max_vruntime(min_vruntime, group->vruntime);
+
+  fair_entity_t* entity = first_entity(group);
+  rb_tree_remove(&group->ready_threads, &entity->rb_node);
+  group->min_vruntime = max_vruntime(group->min_vruntime, entity->vruntime);
+  if (group->ready_threads.size == 0) {
+    rb_tree_remove(&ready_groups, &group->rb_node);
+    group->on_rq = false;
+  }
+  ready_threads_num--;
+  return entity->thread_node;
+}
+
+static uint32 fair_ready_num() {
+  return ready_threads_num;
+}
+
+static bool fair_check_preempt_tick(tcb_t* crt_thread) {
+  fair_group_t* group = thread_group(crt_thread);
+  fair_group_t* first = first_group();
+  if (first != group) {
+    return first->vruntime <= group->vruntime;
+  }
+  return first_entity(group)->vruntime <= crt_thread->fair.vruntime;
+}
+
+static bool fair_check_preempt_wakeup(tcb_t* crt_thread, tcb_t* woken_thread) {
+  fair_group_t* crt_group = thread_group(crt_thread);
+  fair_group_t* woken_group = thread_group(woken_thread);
+  if (crt_group != woken_group) {
+    return woken_group->vruntime + FAIR_WAKEUP_GRANULARITY < crt_group->vruntime;
+  }
+  return woken_thread->fair.vruntime + FAIR_WAKEUP_GRANULARITY < crt_thread->fair.vruntime;
+}
+
+static bool fair_tick(tcb_t* crt_thread) {
+  uint32 tick_us = 1000000 / timer_frequency;
+  fair_entity_t* entity = &crt_thread->fair;
+  entity->vruntime += tick_us * FAIR_NICE_0_WEIGHT / thread_weight(crt_thread);
+
+  // Group vruntime is the key of a tree node, so re-insert it if it's queued.
+  fair_group_t* group = thread_group(crt_thread);
+  if (group->on_rq) {
+    rb_tree_remove(&ready_groups, &group->rb_node);
+    group->vruntime += tick_us;
+    rb_tree_insert(&ready_groups, &group->rb_node);
+  } else {
+    group->vruntime += tick_us;
+  }
+
+  return crt_thread->ticks >= timer_ms_to_ticks(FAIR_TIME_SLICE_MS);
+}
+
+static sched_class_t fair_sched_class = {
+  .name = "fair",
+  .init = fair_init,
+  .enqueue = fair_enqueue,
+  .pick_next = fair_pick_next,
+  .ready_num = fair_ready_num,
+  .check_preempt_tick = fair_check_preempt_tick,
+  .check_preempt_wakeup = fair_check_preempt_wakeup,
+  .tick = fair_tick,
+};
+
+sched_class_t* get_fair_sched_class() {
+  return &fair_sched_class;
+}
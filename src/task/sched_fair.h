@@ -0,0 +1,48 @@
+#ifndef TASK_SCHED_FAIR_H
+#define TASK_SCHED_FAIR_H
+
+#include "common/common.h"
+#include "utils/rb_tree.h"
+
+// Fair-share scheduling: cpu time is first shared equally among processes, and then among
+// threads of a process by their weights. Both levels keep virtual runtime (vruntime), which
+// grows inversely proportional to weight, and always run the entity with minimum vruntime.
+// ****************************************************************************
+
+// vruntime is cpu time in microseconds, scaled by NICE_0 weight / entity weight.
+#define FAIR_NICE_0_WEIGHT     1024
+// Time slice before the tree is checked for a thread with smaller vruntime.
+#define FAIR_TIME_SLICE_MS     80
+// Sleepers are placed this much vruntime behind min_vruntime on wakeup, so they run soon
+// but can not monopolize cpu after a long sleep.
+#define FAIR_WAKEUP_CREDIT     (FAIR_TIME_SLICE_MS * 1000)
+// A woken entity preempts current one only if it's ahead by more than this.
+#define FAIR_WAKEUP_GRANULARITY  5000
+
+// Per process group. All processes have equal weight.
+struct fair_group {
+  uint64 vruntime;
+  // monotonic minimum vruntime of the threads in this group
+  uint64 min_vruntime;
+  // ready threads ordered by vruntime
+  rb_tree_t ready_threads;
+  // node in the global tree of groups that have ready threads
+  rb_node_t rb_node;
+  bool on_rq;
+};
+typedef struct fair_group fair_group_t;
+
+// Per thread.
+struct fair_entity {
+  uint64 vruntime;
+  // node in its group's ready_threads tree
+  rb_node_t rb_node;
+  struct linked_list_node* thread_node;
+};
+typedef struct fair_entity fair_entity_t;
+
+
+// ****************************************************************************
+void fair_group_init(fair_group_t* group);
+
+#endif
@@ -0,0 +1,105 @@
+#include "task/thread.h"
+#include "task/sched_class.h"
+#include "interrupt/timer.h"
+#include "utils/linked_list.h"
+#include "utils/math.h"
+
+// Priority scheduling: one FIFO ready queue for each priority level, and the highest
+// non-empty level always runs first. Threads within a level are round-robin.
+
+// ready task queues, one for each priority level
+static linked_list_t ready_tasks[THREAD_PRIORITY_LEVELS];
+// bit i is set if ready_tasks[i] is not empty
+static uint32 ready_tasks_bitmap = 0;
+static uint32 ready_tasks_num = 0;
+
+static uint32 thread_effective_priority(tcb_t* thread) {
+  return min(thread->priority + thread->boost, THREAD_PRIORITY_MAX);
+}
+
+// Highest priority level which has ready tasks. Ready queues must not be empty.
+static uint32 ready_tasks_highest_priority() {
+  uint32 level;
+  asm volatile("bsr %1, %0" : "=r"(level) : "r"(ready_tasks_bitmap));
+  return level;
+}
+
+static void priority_init() {
+  for (uint32 i = 0; i < THREAD_PRIORITY_LEVELS; i++) {
+    linked_list_init(&ready_tasks[i]);
+  }
+  ready_tasks_bitmap = 0;
+  ready_tasks_num = 0;
+}
+
+// Threads waking up from blocking get a priority boost, so that interactive threads which
+// mostly wait for input run ahead of cpu-bound ones.
+static void priority_enqueue(thread_node_t* thread_node, uint32 flags) {
+  tcb_t* thread = (tcb_t*)thread_node->ptr;
+  if (flags & ENQUEUE_WAKEUP) {
+    thread->boost = THREAD_WAKEUP_BOOST;
+  }
+
+  uint32 level = thread_effective_priority(thread);
+  if (flags & ENQUEUE_HEAD) {
+    linked_list_insert(&ready_tasks[level], nullptr, thread_node);
+  } else {
+    linked_list_append(&ready_tasks[level], thread_node);
+  }
+  ready_tasks_bitmap |= (1 << level);
+  ready_tasks_num++;
+}
+
+static thread_node_t* priority_pick_next() {
+  uint32 level = ready_tasks_highest_priority();
+  linked_list_t* queue = &ready_tasks[level];
+  thread_node_t* head = queue->head;
+  linked_list_remove(queue, head);
+  if (queue->size == 0) {
+    ready_tasks_bitmap &= ~(1 << level);
+  }
+  ready_tasks_num--;
+  return head;
+}
+
+static uint32 priority_ready_num() {
+  return ready_tasks_num;
+}
+
+// A running thread is only preempted by ready threads of equal or higher priority.
+// Otherwise it simply starts a new time slice.
+static bool priority_check_preempt_tick(tcb_t* crt_thread) {
+  return ready_tasks_highest_priority() >= thread_effective_priority(crt_thread);
+}
+
+static bool priority_check_preempt_wakeup(tcb_t* crt_thread, tcb_t* woken_thread) {
+  return thread_effective_priority(woken_thread) > thread_effective_priority(crt_thread);
+}
+
+// Priority is also the time slice length, in units of THREAD_TIME_SLICE_UNIT_MS.
+static bool priority_tick(tcb_t* crt_thread) {
+  uint32 slice_ticks = timer_ms_to_ticks(crt_thread->priority * THREAD_TIME_SLICE_UNIT_MS);
+  if (crt_thread->ticks < slice_ticks) {
+    return false;
+  }
+  // A thread using up whole time slices is cpu-bound, so its wakeup boost decays.
+  if (crt_thread->boost > 0) {
+    crt_thread->boost--;
+  }
+  return true;
+}
+
+static sched_class_t priority_sched_class = {
+  .name = "priority",
+  .init = priority_init,
+  .enqueue = priority_enqueue,
+  .pick_next = priority_pick_next,
+  .ready_num = priority_ready_num,
+  .check_preempt_tick = priority_check_preempt_tick,
+  .check_preempt_wakeup = priority_check_preempt_wakeup,
+  .tick = priority_tick,
+};
+
+sched_class_t* get_priority_sched_class() {
+  return &priority_sched_class;
+}
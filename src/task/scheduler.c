@@ -3,8 +3,10 @@
 #include "task/thread.h"
 #include "task/process.h"
 #include "task/scheduler.h"
+#include "task/sched_class.h"
 #include "syscall/syscall.h"
 #include "interrupt/interrupt.h"
+#include "interrupt/timer.h"
 #include "mem/gdt.h"
 #include "mem/kheap.h"
 #include "mem/paging.h"
@@ -15,13 +17,13 @@
 #include "utils/debug.h"
 
 extern void cpu_idle();
+extern uint32 get_eflags();
 extern void context_switch(tcb_t* crt, tcb_t* next);
 extern void resume_thread();
 
 // ****************************************************************************
 static pcb_t* main_process;
 static thread_node_t* main_thread_node;
-static thread_node_t* kernel_clean_node;
 
 static thread_node_t* crt_thread_node = nullptr;
 
@@ -39,10 +41,11 @@ static cond_var_t dead_resource_cv;
 static hash_table_t threads_map;
 static yieldlock_t threads_map_lock;
 
-// ready task queue
-static linked_list_t ready_tasks;
+// scheduling class which manages ready threads
+static sched_class_t* sched_class;
 
-static bool main_thread_in_ready_queue = false;
+// timer ticks since multi tasks started, including cpu idle
+static uint32 total_cpu_ticks = 0;
 
 static bool multi_task_enabled = false;
 
@@ -57,10 +60,15 @@ bool multi_task_is_enabled() {
   return multi_task_enabled;
 }
 
-void init_scheduler() {
+void init_scheduler(enum sched_policy policy) {
   disable_interrupt();
 
-  linked_list_init(&ready_tasks);
+  if (policy == SCHED_POLICY_FAIR) {
+    sched_class = get_fair_sched_class();
+  } else {
+    sched_class = get_priority_sched_class();
+  }
+  sched_class->init();
 
   hash_table_init(&processes_map);
   yieldlock_init(&processes_map_lock);
@@ -76,8 +84,8 @@ void init_scheduler() {
   // Create process 0: kernel main process (cpu idle)
   main_process = create_process("kernel_main_process", /* is_kernel_process = */true);
   tcb_t* main_thread = create_new_kernel_thread(main_process, "kernel main", kernel_main_thread);
-  main_thread_node = (thread_node_t*)kmalloc(sizeof(thread_node_t));
-  main_thread_node->ptr = main_thread;
+  main_thread->priority = THREAD_IDLE_PRIORITY;
+  main_thread_node = &main_thread->run_node;
   crt_thread_node = main_thread_node;
 
   // Kick off!
@@ -96,9 +104,7 @@ void init_scheduler() {
 static void kernel_main_thread() {
   // Create kernel clean thread.
   tcb_t* clean_thread = create_new_kernel_thread(main_process, "kernel clean", kernel_clean_thread);
-  kernel_clean_node = (thread_node_t*)kmalloc(sizeof(thread_node_t));
-  kernel_clean_node->ptr = clean_thread;
-  add_thread_node_to_schedule(kernel_clean_node);
+  add_thread_to_schedule(clean_thread);
 
   // Create process 1: init process.
   pcb_t* init_process = create_process(nullptr, /* is_kernel_process = */true);
@@ -111,10 +117,18 @@ static void kernel_main_thread() {
 
   // Enter cpu idle.
   while (true) {
+    disable_interrupt();
+    timer_idle_enter();
     cpu_idle();
   }
 }
 
+tcb_t* start_kernel_thread(char* name, void* function) {
+  tcb_t* thread = create_new_kernel_thread(main_process, name, function);
+  add_thread_to_schedule(thread);
+  return thread;
+}
+
 static void kernel_clean_thread() {
   // thread-1
   while (true) {
@@ -134,7 +148,6 @@ static void kernel_clean_thread() {
         tcb_t* thread = (tcb_t*)head->ptr;
         //monitor_printf("clean thread %d\n", thread->id);
         destroy_thread(thread);
-        kfree(head);
       }
     }
 
@@ -202,6 +215,45 @@ void add_new_process(pcb_t* process) {
   yieldlock_unlock(&processes_map_lock);
 }
 
+void remove_process(pcb_t* process) {
+  yieldlock_lock(&processes_map_lock);
+  hash_table_remove(&processes_map, process->id);
+  yieldlock_unlock(&processes_map_lock);
+}
+
+static void print_padded(uint32 value, uint32 width) {
+  uint32 length = 1;
+  uint32 v = value;
+  while ((v /= 10) > 0) {
+    length++;
+  }
+  monitor_printf("%u", value);
+  for (uint32 i = length; i < width; i++) {
+    monitor_printf(" ");
+  }
+}
+
+// Print cpu share of each process. Ticks of kernel main process include cpu idle.
+int32 list_processes() {
+  uint32 total_ticks = total_cpu_ticks > 0 ? total_cpu_ticks : 1;
+  monitor_printf("scheduler: %s, total ticks: %u\n", sched_class->name, total_cpu_ticks);
+  monitor_println("PID   THREADS  TICKS     CPU%  NAME");
+
+  yieldlock_lock(&processes_map_lock);
+  hash_table_interator_t iter = hash_table_create_iterator(&processes_map);
+  while (hash_table_iterator_has_next(&iter)) {
+    hash_table_kv_t* kv_node = hash_table_iterator_next(&iter);
+    pcb_t* process = (pcb_t*)kv_node->v_ptr;
+    print_padded(process->id, 6);
+    print_padded(process->threads.size, 9);
+    print_padded(process->cpu_ticks, 10);
+    print_padded(process->cpu_ticks * 100 / total_ticks, 6);
+    monitor_printf("%s\n", process->name);
+  }
+  yieldlock_unlock(&processes_map_lock);
+  return 0;
+}
+
 void add_dead_process(pcb_t* process) {
   yieldlock_lock(&dead_resource_lock);
   linked_list_append_ele(&dead_processes, process);
@@ -211,7 +263,7 @@ void add_dead_process(pcb_t* process) {
 
 void add_dead_task(tcb_t* thread) {
   yieldlock_lock(&dead_resource_lock);
-  linked_list_append_ele(&dead_tasks, thread);
+  linked_list_append(&dead_tasks, &thread->run_node);
   cond_var_notify(&dead_resource_cv);
   yieldlock_unlock(&dead_resource_lock);
 }
@@ -225,17 +277,20 @@ static void process_switch(pcb_t* process) {
 
 // Note: interrupt must be DISABLED before entering this function.
 static void do_context_switch() {
-  //monitor_printf("ready_tasks num = %d\n", ready_tasks.size);
+  //monitor_printf("ready_tasks num = %d\n", sched_class->ready_num());
   tcb_t* old_thread = get_crt_thread();
 
-  thread_node_t* head = ready_tasks.head;
-  linked_list_remove(&ready_tasks, head);
+  // If no ready task in queue, switch to kernel main (cpu idle) thread.
+  thread_node_t* head = main_thread_node;
+  if (sched_class->ready_num() > 0) {
+    head = sched_class->pick_next();
+  }
   tcb_t* next_thread = (tcb_t*)head->ptr;
 
   // Switch out current running thread.
   if (old_thread->status == TASK_RUNNING && crt_thread_node != main_thread_node) {
     old_thread->status = TASK_READY;
-    linked_list_append(&ready_tasks, crt_thread_node);
+    sched_class->enqueue(crt_thread_node, 0);
   }
   old_thread->ticks = 0;
   old_thread->need_reschedule = false;
@@ -243,12 +298,10 @@ static void do_context_switch() {
   // Switch in next thread.
   next_thread->status = TASK_RUNNING;
   crt_thread_node = head;
-  if (head == main_thread_node) {
-    main_thread_in_ready_queue = 0;
-  }
 
   // Setup env for next thread (and maybe a different process)
   update_tss_esp(next_thread->kernel_stack + KERNEL_STACK_SIZE);
+  kmap_switch(&old_thread->kmap, &next_thread->kmap);
   if (old_thread->process != next_thread->process) {
     process_switch(next_thread->process);
   }
@@ -266,12 +319,20 @@ void schedule() {
     return;
   }
   bool need_context_switch = false;
-  if (ready_tasks.size > 0) {
-    need_context_switch = crt_thread->need_reschedule;
+  if (sched_class->ready_num() > 0 && crt_thread->need_reschedule) {
+    // The scheduling class decides whether a running thread is preempted. Otherwise it
+    // simply starts a new time slice.
+    if (crt_thread_node == main_thread_node || crt_thread->status != TASK_RUNNING ||
+        sched_class->check_preempt_tick(crt_thread)) {
+      need_context_switch = true;
+    } else {
+      crt_thread->ticks = 0;
+      crt_thread->need_reschedule = false;
+    }
   }
 
   if (need_context_switch) {
-    //monitor_printf("context_switch yes, %d ready tasks\n", ready_tasks.size);
+    //monitor_printf("context_switch yes, %d ready tasks\n", sched_class->ready_num());
     do_context_switch();
   } else {
     //monitor_println("context_switch no");
@@ -279,42 +340,81 @@ void schedule() {
   }
 }
 
-void add_thread_to_schedule(tcb_t* thread) {
-  thread_node_t* node = (thread_node_t*)kmalloc(sizeof(thread_node_t));
-  node->ptr = (void*)thread;
-  add_thread_node_to_schedule(node);
-}
-
-void add_thread_node_to_schedule(thread_node_t* thread_node) {
+// Can be called from interrupt context, so interrupt flag is restored rather than enabled.
+static void wake_up_thread_node(thread_node_t* thread_node, uint32 flags) {
+  uint32 eflags = get_eflags();
   disable_interrupt();
   tcb_t* thread = (tcb_t*)thread_node->ptr;
+  if (thread->status == TASK_WAITING) {
+    flags |= ENQUEUE_WAKEUP;
+  }
   if (thread->status != TASK_DEAD) {
     thread->status = TASK_READY;
   }
-  linked_list_append(&ready_tasks, thread_node);
-  enable_interrupt();
+  sched_class->enqueue(thread_node, flags);
+
+  // Cpu idle thread is always preempted, otherwise ask the scheduling class.
+  tcb_t* crt_thread = get_crt_thread();
+  if (crt_thread != nullptr && (crt_thread_node == main_thread_node ||
+                                sched_class->check_preempt_wakeup(crt_thread, thread))) {
+    crt_thread->need_reschedule = true;
+  }
+  if (eflags & (1 << 9)) {
+    enable_interrupt();
+  }
 }
 
-void add_thread_node_to_schedule_head(thread_node_t* thread_node) {
-  disable_interrupt();
-  tcb_t* thread = (tcb_t*)thread_node->ptr;
-  thread->status = TASK_READY;
-  linked_list_insert_to_head(&ready_tasks, thread_node);
-  enable_interrupt();
+void add_thread_to_schedule(tcb_t* thread) {
+  wake_up_thread_node(&thread->run_node, 0);
+}
+
+void add_thread_to_schedule_head(tcb_t* thread) {
+  wake_up_thread_node(&thread->run_node, ENQUEUE_HEAD);
+}
+
+int32 schedule_set_thread_priority(tcb_t* thread, uint32 priority) {
+  if (priority < THREAD_PRIORITY_MIN || priority > THREAD_PRIORITY_MAX) {
+    return -1;
+  }
+  thread->priority = priority;
+  // Let the scheduler re-evaluate current thread with its new priority.
+  if (thread == get_crt_thread()) {
+    thread->need_reschedule = true;
+  }
+  return 0;
 }
 
 void schedule_thread_yield() {
   disable_interrupt();
 
   //monitor_printf("thread %d yield\n", get_crt_thread()->id);
+  do_context_switch();
+}
 
-  // If no ready task in queue, wake up kernel main (cpu idle) thread.
-  if (ready_tasks.size == 0) {
-    linked_list_append(&ready_tasks, main_thread_node);
-    main_thread_in_ready_queue = 1;
+// Called by timer interrupt.
+void schedule_tick() {
+  total_cpu_ticks++;
+  tcb_t* crt_thread = get_crt_thread();
+  crt_thread->ticks++;
+  pcb_t* process = crt_thread->process;
+  if (process != nullptr) {
+    process->cpu_ticks++;
   }
 
-  do_context_switch();
+  // Cpu idle thread gives up cpu whenever there are ready threads.
+  if (crt_thread_node == main_thread_node) {
+    crt_thread->need_reschedule = true;
+    return;
+  }
+  if (sched_class->tick(crt_thread)) {
+    crt_thread->need_reschedule = true;
+  }
+}
+
+// Ticks skipped in tickless idle are accounted to cpu idle.
+void schedule_idle_ticks(uint32 ticks) {
+  total_cpu_ticks += ticks;
+  main_process->cpu_ticks += ticks;
 }
 
 void schedule_mark_thread_block() {
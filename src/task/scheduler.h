@@ -3,8 +3,18 @@
 
 #include "task/thread.h"
 
+enum sched_policy {
+  SCHED_POLICY_PRIORITY,
+  SCHED_POLICY_FAIR
+};
+
+// Scheduling policy selected at boot:
+//  - SCHED_POLICY_PRIORITY: strict priority levels, round-robin within each level;
+//  - SCHED_POLICY_FAIR: cpu time shared fairly among processes, then among their threads;
+#define SCHEDULER_POLICY SCHED_POLICY_PRIORITY
+
 // Init scheduler.
-void init_scheduler();
+void init_scheduler(enum sched_policy policy);
 
 // Get current running thread.
 tcb_t* get_crt_thread();
@@ -14,10 +24,13 @@ pcb_t* get_crt_process();
 // If current running thread is kernel main thread.
 bool is_kernel_main_thread();
 
-// Add thread to ready task queue and wait for schedule.
+// Add thread to ready task queue and wait for schedule. Ready queue links the run_node
+// embedded in tcb, so this never allocates memory.
 void add_thread_to_schedule(struct task_struct* thread);
-void add_thread_node_to_schedule(thread_node_t* thread_node);
-void add_thread_node_to_schedule_head(thread_node_t* thread_node);
+void add_thread_to_schedule_head(struct task_struct* thread);
+
+// Set the static priority of a thread. It takes effect the next time the thread is queued.
+int32 schedule_set_thread_priority(tcb_t* thread, uint32 priority);
 
 // Call scheduler.
 void schedule();
@@ -25,16 +38,28 @@ void schedule();
 // Yield thread - give up cpu and move current thread to ready queue tail.
 void schedule_thread_yield();
 
+// Time slice accounting, called by timer interrupt.
+void schedule_tick();
+void schedule_idle_ticks(uint32 ticks);
+
 // Mark current thread WAITING.
 void schedule_mark_thread_block();
 
 void schedule_thread_exit();
 void schedule_thread_exit_normal();
 
+// Create a kernel thread in kernel main process, and schedule it. Only called after
+// multitasking is enabled.
+tcb_t* start_kernel_thread(char* name, void* function);
+
 // Add process to scheduler
 void add_new_process(pcb_t* process);
+void remove_process(pcb_t* process);
 void add_dead_process(pcb_t* process);
 
+// Print cpu share of each process.
+int32 list_processes();
+
 bool multi_task_is_enabled();
 
 void disable_preempt();
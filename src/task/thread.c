@@ -46,7 +46,13 @@ tcb_t* init_thread(tcb_t* thread, char* name, thread_func function, uint32 prior
   thread->status = TASK_READY;
   thread->ticks = 0;
   thread->priority = priority;
+  thread->boost = 0;
+  thread->fair.vruntime = 0;
   thread->user_stack_index = -1;
+  thread->kmap.slots_used = 0;
+  thread->run_node.ptr = thread;
+  thread->wait_node.ptr = thread;
+  thread->wait_queue = nullptr;
 
   // Init thread stack.
   uint32 kernel_stack = (uint32)kmalloc_aligned(KERNEL_STACK_SIZE);
@@ -179,6 +185,10 @@ tcb_t* fork_crt_thread() {
   strcpy(thread->name, buf);
 
   thread->ticks = 0;
+  thread->kmap.slots_used = 0;
+  thread->run_node.ptr = thread;
+  thread->wait_node.ptr = thread;
+  thread->wait_queue = nullptr;
 
   // allocate kernel stack
   uint32 kernel_stack = (uint32)kmalloc_aligned(KERNEL_STACK_SIZE);
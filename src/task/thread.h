@@ -4,11 +4,24 @@
 #include "common/common.h"
 #include "interrupt/interrupt.h"
 #include "task/process.h"
+#include "task/sched_fair.h"
+#include "mem/paging.h"
 #include "utils/linked_list.h"
 
 #define KERNEL_MAIN_STACK_TOP    0xF0000000
 #define THREAD_STACK_MAGIC       0x32602021
+
+// Priority levels: the higher the level, the earlier a thread is scheduled. Level 0 is
+// reserved for the cpu idle thread. Priority is also the time slice length in units of
+// THREAD_TIME_SLICE_UNIT_MS.
+#define THREAD_PRIORITY_LEVELS   32
+#define THREAD_PRIORITY_MIN      1
+#define THREAD_PRIORITY_MAX      (THREAD_PRIORITY_LEVELS - 1)
+#define THREAD_IDLE_PRIORITY     0
 #define THREAD_DEFAULT_PRIORITY  10
+#define THREAD_TIME_SLICE_UNIT_MS  20
+// Dynamic priority boost for threads waking up from blocking.
+#define THREAD_WAKEUP_BOOST      4
 
 #define KERNEL_STACK_SIZE  8192
 
@@ -40,9 +53,13 @@ struct task_struct {
   uint32 id;
   char name[32];
   uint8 priority;
+  // dynamic priority boost, decays as the thread uses up its time slices
+  uint8 boost;
   enum task_status status;
   // timer ticks this thread has been running for.
   uint32 ticks;
+  // fair scheduling entity
+  fair_entity_t fair;
   // pointer to its process
   struct process_struct* process;
   // user stack
@@ -52,6 +69,16 @@ struct task_struct {
   bool need_reschedule;
   // preempt (disable) count
   uint32 preempt_count;
+  // temporary frame mappings
+  kmap_ctrl_t kmap;
+  // node in ready queue (or dead tasks list), ptr points to this thread
+  thread_node_t run_node;
+  // node in a wait queue, ptr points to this thread
+  thread_node_t wait_node;
+  // wait queue this thread is sleeping on
+  struct wait_queue* wait_queue;
+  // set by wait timer when timeout
+  bool wait_timed_out;
 };
 typedef struct task_struct tcb_t;
 
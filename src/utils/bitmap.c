@@ -74,6 +74,25 @@ bool bitmap_allocate_first_free(bitmap_t* this, uint32* bit) {
   return true;
 }
 
+bool bitmap_allocate_first_free_range(bitmap_t* this, uint32 num, uint32* bit) {
+  uint32 run = 0;
+  for (uint32 i = 0; i < this->total_bits; i++) {
+    if (bitmap_test_bit(this, i)) {
+      run = 0;
+      continue;
+    }
+    run++;
+    if (run == num) {
+      *bit = i + 1 - num;
+      for (uint32 j = *bit; j <= i; j++) {
+        bitmap_set_bit(this, j);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
 void bitmap_clear(bitmap_t* this) {
   for (uint32 i = 0; i < this->array_size; i++) {
     this->array[i] = 0;
@@ -33,4 +33,7 @@ void bitmap_destroy(bitmap_t* this);
 bool bitmap_find_first_free(bitmap_t* this, uint32* bit);
 bool bitmap_allocate_first_free(bitmap_t* this, uint32* bit);
 
+// Find and set the first num consecutive free bits, and store the first one in *bit.
+bool bitmap_allocate_first_free_range(bitmap_t* this, uint32 num, uint32* bit);
+
 #endif
@@ -0,0 +1,21 @@
+#include "utils/crc32.h"
+
+static uint32 crc_table[256];
+
+void init_crc32() {
+  for (uint32 i = 0; i < 256; i++) {
+    uint32 crc = i;
+    for (uint32 bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+    }
+    crc_table[i] = crc;
+  }
+}
+
+uint32 crc32(char* data, uint32 length) {
+  uint32 crc = 0xFFFFFFFF;
+  for (uint32 i = 0; i < length; i++) {
+    crc = crc_table[(crc ^ (uint8)data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFF;
+}
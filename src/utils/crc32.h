@@ -0,0 +1,12 @@
+#ifndef UTILS_CRC32_H
+#define UTILS_CRC32_H
+
+#include "common/common.h"
+
+// Build the lookup table, before any crc32() call.
+void init_crc32();
+
+// CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320), as computed by zlib.
+uint32 crc32(char* data, uint32 length);
+
+#endif
@@ -18,4 +18,21 @@ int32 div(int32 x, int32 N) {
 
 int32 mod(int32 x, int32 N) {
   return (x % N + N) %N;
-}
\ No newline at end of file
+}
+
+// 64-bit by 32-bit division, without libgcc. Two divl's: the high word first, then the
+// remainder with the low word, whose quotient always fits in 32 bits.
+uint64 udiv64_32(uint64 n, uint32 d, uint32* remainder) {
+  uint32 high = (uint32)(n >> 32);
+  uint32 low = (uint32)n;
+  uint32 q_high = high / d;
+  uint32 r = high % d;
+  uint32 q_low;
+  asm volatile("divl %4"
+               : "=a"(q_low), "=d"(r)
+               : "a"(low), "d"(r), "rm"(d));
+  if (remainder != nullptr) {
+    *remainder = r;
+  }
+  return ((uint64)q_high << 32) | q_low;
+}
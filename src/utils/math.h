@@ -11,4 +11,7 @@ int32 div(int32 x, int32 N);
 
 int32 mod(int32 x, int32 N);
 
+// n / d, and optionally n % d.
+uint64 udiv64_32(uint64 n, uint32 d, uint32* remainder);
+
 #endif
@@ -1,5 +1,5 @@
 #include "utils/rand.h"
-#include "interrupt/timer.h"
+#include "interrupt/clock.h"
 
 static uint32 seed = 0;
 static uint32 rand_a = 1103515245;
@@ -11,7 +11,9 @@ void rand_seed(uint32 new_seed) {
 }
 
 void rand_seed_with_time() {
-  rand_seed(getTick());
+  // Low bits of the nanosecond clock vary a lot more than ticks.
+  uint64 ns = clock_monotonic_ns();
+  rand_seed((uint32)ns ^ (uint32)(ns >> 32));
 }
 
 uint32 rand() {
@@ -0,0 +1,347 @@
+#include "mem/kheap.h"
+#include "monitor/monitor.h"
+#include "utils/rb_tree.h"
+#include "utils/debug.h"
+
+void rb_tree_init(rb_tree_t* this, rb_comparator_t comparator) {
+  this->root = nullptr;
+  this->leftmost = nullptr;
+  this->size = 0;
+  this->comparator = comparator;
+}
+
+static bool is_red(rb_node_t* node) {
+  return node != nullptr && node->color == RB_RED;
+}
+
+static bool is_black(rb_node_t* node) {
+  return node == nullptr || node->color == RB_BLACK;
+}
+
+static rb_node_t* minimum(rb_node_t* node) {
+  while (node->left != nullptr) {
+    node = node->left;
+  }
+  return node;
+}
+
+// Replace subtree u with subtree v in u's parent.
+static void replace_child(rb_tree_t* this, rb_node_t* u, rb_node_t* v) {
+  if (u->parent == nullptr) {
+    this->root = v;
+  } else if (u == u->parent->left) {
+    u->parent->left = v;
+  } else {
+    u->parent->right = v;
+  }
+  if (v != nullptr) {
+    v->parent = u->parent;
+  }
+}
+
+static void rotate_left(rb_tree_t* this, rb_node_t* x) {
+  rb_node_t* y = x->right;
+  x->right = y->left;
+  if (y->left != nullptr) {
+    y->left->parent = x;
+  }
+  replace_child(this, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+static void rotate_right(rb_tree_t* this, rb_node_t* x) {
+  rb_node_t* y = x->left;
+  x->left = y->right;
+  if (y->right != nullptr) {
+    y->right->parent = x;
+  }
+  replace_child(this, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+void rb_tree_insert(rb_tree_t* this, rb_node_t* node) {
+  node->left = nullptr;
+  node->right = nullptr;
+  node->color = RB_RED;
+
+  // Binary search tree insert.
+  rb_node_t* parent = nullptr;
+  rb_node_t* crt = this->root;
+  bool is_leftmost = true;
+  while (crt != nullptr) {
+    parent = crt;
+    if (this->comparator(node, crt) < 0) {
+      crt = crt->left;
+    } else {
+      crt = crt->right;
+      is_leftmost = false;
+    }
+  }
+  node->parent = parent;
+  if (parent == nullptr) {
+    this->root = node;
+  } else if (this->comparator(node, parent) < 0) {
+    parent->left = node;
+  } else {
+    parent->right = node;
+  }
+  if (is_leftmost) {
+    this->leftmost = node;
+  }
+  this->size++;
+
+  // Fix red-red violations up the tree.
+  while (is_red(node->parent)) {
+    rb_node_t* p = node->parent;
+    rb_node_t* g = p->parent;
+    if (p == g->left) {
+      rb_node_t* uncle = g->right;
+      if (is_red(uncle)) {
+        p->color = RB_BLACK;
+        uncle->color = RB_BLACK;
+        g->color = RB_RED;
+        node = g;
+        continue;
+      }
+      if (node == p->right) {
+        rotate_left(this, p);
+        node = p;
+        p = node->parent;
+      }
+      p->color = RB_BLACK;
+      g->color = RB_RED;
+      rotate_right(this, g);
+    } else {
+      rb_node_t* uncle = g->left;
+      if (is_red(uncle)) {
+        p->color = RB_BLACK;
+        uncle->color = RB_BLACK;
+        g->color = RB_RED;
+        node = g;
+        continue;
+      }
+      if (node == p->left) {
+        rotate_right(this, p);
+        node = p;
+        p = node->parent;
+      }
+      p->color = RB_BLACK;
+      g->color = RB_RED;
+      rotate_left(this, g);
+    }
+  }
+  this->root->color = RB_BLACK;
+}
+
+// Fix double black at x, whose parent is parent (x may be nullptr).
+static void remove_fixup(rb_tree_t* this, rb_node_t* x, rb_node_t* parent) {
+  while (x != this->root && is_black(x)) {
+    if (x == parent->left) {
+      rb_node_t* w = parent->right;
+      if (is_red(w)) {
+        w->color = RB_BLACK;
+        parent->color = RB_RED;
+        rotate_left(this, parent);
+        w = parent->right;
+      }
+      if (is_black(w->left) && is_black(w->right)) {
+        w->color = RB_RED;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (is_black(w->right)) {
+          w->left->color = RB_BLACK;
+          w->color = RB_RED;
+          rotate_right(this, w);
+          w = parent->right;
+        }
+        w->color = parent->color;
+        parent->color = RB_BLACK;
+        w->right->color = RB_BLACK;
+        rotate_left(this, parent);
+        x = this->root;
+      }
+    } else {
+      rb_node_t* w = parent->left;
+      if (is_red(w)) {
+        w->color = RB_BLACK;
+        parent->color = RB_RED;
+        rotate_right(this, parent);
+        w = parent->left;
+      }
+      if (is_black(w->left) && is_black(w->right)) {
+        w->color = RB_RED;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (is_black(w->left)) {
+          w->right->color = RB_BLACK;
+          w->color = RB_RED;
+          rotate_left(this, w);
+          w = parent->left;
+        }
+        w->color = parent->color;
+        parent->color = RB_BLACK;
+        w->left->color = RB_BLACK;
+        rotate_right(this, parent);
+        x = this->root;
+      }
+    }
+  }
+  if (x != nullptr) {
+    x->color = RB_BLACK;
+  }
+}
+
+void rb_tree_remove(rb_tree_t* this, rb_node_t* node) {
+  if (this->leftmost == node) {
+    this->leftmost = rb_tree_next(node);
+  }
+
+  rb_node_t* x;
+  rb_node_t* x_parent;
+  uint8 removed_color = node->color;
+  if (node->left == nullptr) {
+    x = node->right;
+    x_parent = node->parent;
+    replace_child(this, node, node->right);
+  } else if (node->right == nullptr) {
+    x = node->left;
+    x_parent = node->parent;
+    replace_child(this, node, node->left);
+  } else {
+    // Replace node with its successor y.
+    rb_node_t* y = minimum(node->right);
+    removed_color = y->color;
+    x = y->right;
+    if (y->parent == node) {
+      x_parent = y;
+    } else {
+      x_parent = y->parent;
+      replace_child(this, y, y->right);
+      y->right = node->right;
+      y->right->parent = y;
+    }
+    replace_child(this, node, y);
+    y->left = node->left;
+    y->left->parent = y;
+    y->color = node->color;
+  }
+  this->size--;
+
+  if (removed_color == RB_BLACK) {
+    remove_fixup(this, x, x_parent);
+  }
+
+  node->parent = nullptr;
+  node->left = nullptr;
+  node->right = nullptr;
+}
+
+rb_node_t* rb_tree_first(rb_tree_t* this) {
+  return this->leftmost;
+}
+
+rb_node_t* rb_tree_next(rb_node_t* node) {
+  if (node->right != nullptr) {
+    return minimum(node->right);
+  }
+  rb_node_t* parent = node->parent;
+  while (parent != nullptr && node == parent->right) {
+    node = parent;
+    parent = parent->parent;
+  }
+  return parent;
+}
+
+
+// ****************************** unit test ***********************************
+struct rb_test_item {
+  uint32 key;
+  rb_node_t node;
+};
+typedef struct rb_test_item rb_test_item_t;
+
+static int32 rb_test_comparator(rb_node_t* a, rb_node_t* b) {
+  uint32 key_a = container_of(a, rb_test_item_t, node)->key;
+  uint32 key_b = container_of(b, rb_test_item_t, node)->key;
+  return key_a < key_b ? -1 : (key_a == key_b ? 0 : 1);
+}
+
+// Return black height of subtree, and verify red-black properties.
+static int32 rb_test_verify(rb_node_t* node) {
+  if (node == nullptr) {
+    return 1;
+  }
+  if (is_red(node)) {
+    ASSERT(is_black(node->left) && is_black(node->right));
+  }
+  if (node->left != nullptr) {
+    ASSERT(node->left->parent == node);
+  }
+  if (node->right != nullptr) {
+    ASSERT(node->right->parent == node);
+  }
+  int32 left_height = rb_test_verify(node->left);
+  int32 right_height = rb_test_verify(node->right);
+  ASSERT(left_height == right_height);
+  return left_height + (is_black(node) ? 1 : 0);
+}
+
+void rb_tree_test() {
+  monitor_printf("rb_tree test ... ");
+
+  rb_tree_t tree;
+  rb_tree_init(&tree, rb_test_comparator);
+  ASSERT(rb_tree_first(&tree) == nullptr);
+
+  uint32 num = 200;
+  rb_test_item_t* items = (rb_test_item_t*)kmalloc(num * sizeof(rb_test_item_t));
+  for (uint32 i = 0; i < num; i++) {
+    // Insert keys in a scrambled order.
+    items[i].key = (i * 7919) % num;
+    rb_tree_insert(&tree, &items[i].node);
+    ASSERT(tree.size == i + 1);
+  }
+  ASSERT(is_black(tree.root));
+  rb_test_verify(tree.root);
+
+  // In-order traversal must be sorted.
+  uint32 expected = 0;
+  rb_node_t* node = rb_tree_first(&tree);
+  while (node != nullptr) {
+    ASSERT(container_of(node, rb_test_item_t, node)->key == expected);
+    expected++;
+    node = rb_tree_next(node);
+  }
+  ASSERT(expected == num);
+
+  // Remove half of the nodes, the minimum must be kept updated.
+  for (uint32 i = 0; i < num; i += 2) {
+    rb_tree_remove(&tree, &items[i].node);
+    rb_test_verify(tree.root);
+  }
+  ASSERT(tree.size == num / 2);
+  ASSERT(rb_tree_first(&tree) == minimum(tree.root));
+  uint32 last_key = 0;
+  node = rb_tree_first(&tree);
+  while (node != nullptr) {
+    uint32 key = container_of(node, rb_test_item_t, node)->key;
+    ASSERT(key >= last_key);
+    last_key = key;
+    node = rb_tree_next(node);
+  }
+
+  for (uint32 i = 1; i < num; i += 2) {
+    rb_tree_remove(&tree, &items[i].node);
+  }
+  ASSERT(tree.size == 0);
+  ASSERT(tree.root == nullptr);
+  ASSERT(rb_tree_first(&tree) == nullptr);
+
+  kfree(items);
+
+  monitor_print_with_color("OK\n", COLOR_GREEN);
+}
@@ -0,0 +1,50 @@
+#ifndef UTILS_RB_TREE_H
+#define UTILS_RB_TREE_H
+
+#include "common/common.h"
+
+// Intrusive red-black tree. Nodes are embedded in the owner structs, so insert and remove
+// never allocate memory. Use container_of to get the owner struct of a node.
+// ****************************************************************************
+#define RB_RED    0
+#define RB_BLACK  1
+
+struct rb_node {
+  struct rb_node* parent;
+  struct rb_node* left;
+  struct rb_node* right;
+  uint8 color;
+};
+typedef struct rb_node rb_node_t;
+
+// Returns -1, 0 or 1 if the first node is less than, equal to or greater than the second.
+typedef int32 (*rb_comparator_t)(rb_node_t*, rb_node_t*);
+
+struct rb_tree {
+  rb_node_t* root;
+  // cached minimum node
+  rb_node_t* leftmost;
+  uint32 size;
+  rb_comparator_t comparator;
+};
+typedef struct rb_tree rb_tree_t;
+
+
+void rb_tree_init(rb_tree_t* this, rb_comparator_t comparator);
+
+// Equal nodes are inserted after existing ones.
+void rb_tree_insert(rb_tree_t* this, rb_node_t* node);
+
+void rb_tree_remove(rb_tree_t* this, rb_node_t* node);
+
+// Return the minimum node, or nullptr if tree is empty.
+rb_node_t* rb_tree_first(rb_tree_t* this);
+
+// In-order successor.
+rb_node_t* rb_tree_next(rb_node_t* node);
+
+
+// ****************************** unit test ***********************************
+void rb_tree_test();
+
+#endif
@@ -1,9 +1,91 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
 
+// naive fs v2 image, see src/fs/naive_fs.h
+#define NAIVE_FS_MAGIC       0x3253464E
+#define NAIVE_FS_VERSION     2
+#define NAIVE_FS_DATA_ALIGN  4096
+#define NAIVE_FS_INDEX_MIN   16
+#define SUPERBLOCK_SIZE      512
+// Disk offset the image is written at, HARD_DISK_BOOT_SECTORS in src/driver/hard_disk.h. File
+// data is aligned on disk, not in the partition.
+#define PARTITION_OFFSET     (2057 * 512)
+
+struct superblock {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t file_num;
+  uint32_t metas_offset;
+  uint32_t index_offset;
+  uint32_t index_size;
+  uint32_t data_offset;
+};
+
+struct file_meta {
+  char filename[64];
+  uint32_t size;
+  uint32_t offset;
+  uint32_t crc;
+};
+
+struct index_slot {
+  uint32_t hash;
+  uint32_t meta;
+};
+
+static uint32_t align_up(uint32_t x, uint32_t align) {
+  return (x + align - 1) / align * align;
+}
+
+// Next partition offset from x which is aligned on disk.
+static uint32_t align_data(uint32_t x) {
+  return align_up(PARTITION_OFFSET + x, NAIVE_FS_DATA_ALIGN) - PARTITION_OFFSET;
+}
+
+// Same as naive fs filename_hash, FNV-1a.
+static uint32_t filename_hash(char* filename) {
+  uint32_t hash = 2166136261u;
+  for (char* c = filename; *c != '\0'; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+static uint32_t crc32(char* data, uint32_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint32_t i = 0; i < length; i++) {
+    crc ^= (uint8_t)data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+    }
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+static char* read_file(char* file_path, uint32_t size) {
+  FILE* file;
+  if ((file = fopen(file_path, "r")) == 0) {
+    printf("open %s failed!\n", file_path);
+    exit(1);
+  }
+  char* buffer = (char*)malloc(size > 0 ? size : 1);
+  if (fread(buffer, 1, size, file) != size) {
+    printf("read %s failed!\n", file_path);
+    exit(1);
+  }
+  fclose(file);
+  return buffer;
+}
+
+static int compare_names(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
 int main(int argc, char* argv[]) {
   char* dir_path = "./progs";
   if (argc > 1) {
@@ -11,135 +93,133 @@ int main(int argc, char* argv[]) {
   }
 
   char* file_names[256];
-  char* file_paths[256];
+  char file_paths[256][512];
 
-  // List all programs.
+  // List all programs, sorted so that the image is the same on every build.
   DIR *d = opendir(dir_path);
   struct dirent *dir;
-  int num = 0;
+  uint32_t num = 0;
   if (d) {
     while ((dir = readdir(d)) != NULL) {
       if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) {
         continue;
       }
-
-      char* filename = (char*)malloc(strlen(dir->d_name) + 1);
-      strcat(filename, dir->d_name);
-      file_names[num] = filename;
-
-      char* filepath = (char*)malloc(strlen(dir->d_name) + strlen(dir_path) + 2);
-      strcat(filepath, dir_path);
-      strcat(filepath, "/");
-      strcat(filepath, dir->d_name);
-      file_paths[num] = filepath;
-
-      num++;
+      if (strlen(dir->d_name) >= 64) {
+        printf("file name %s too long\n", dir->d_name);
+        exit(1);
+      }
+      if (num == 256) {
+        printf("too many files\n");
+        exit(1);
+      }
+      file_names[num++] = strdup(dir->d_name);
     }
     closedir(d);
   }
-
-  // Create disk image file.
-  FILE* image_file;
-  char buffer[100] = "This is a test";
-  if ((image_file = fopen("./user_disk_image", "w+")) == 0) {
-    printf("create image file failed");
-    exit(1);
+  qsort(file_names, num, sizeof(char*), compare_names);
+  for (uint32_t i = 0; i < num; i++) {
+    snprintf(file_paths[i], sizeof(file_paths[i]), "%s/%s", dir_path, file_names[i]);
   }
 
-  fwrite((const void*)&num, sizeof(int), 1, image_file);
-  char char_end = '\0';
-
-  int data_offset = sizeof(int) + num * (64 + sizeof(int) + sizeof(int));
-  int file_size[num];
-  int file_data_offsets[num];
-
-  // Write meta data.
-  for (int i = 0; i < num; i++) {
-    char* file_name = file_names[i];
-    char* file_path = file_paths[i];
+  // Layout: superblock, metas, index, then file data each at NAIVE_FS_DATA_ALIGN of disk.
+  struct superblock sb;
+  memset(&sb, 0, sizeof(sb));
+  sb.magic = NAIVE_FS_MAGIC;
+  sb.version = NAIVE_FS_VERSION;
+  sb.file_num = num;
+  sb.metas_offset = SUPERBLOCK_SIZE;
+  sb.index_offset = sb.metas_offset + num * sizeof(struct file_meta);
+  sb.index_size = NAIVE_FS_INDEX_MIN;
+  while (sb.index_size < num * 2) {
+    sb.index_size *= 2;
+  }
+  sb.data_offset = align_data(sb.index_offset + sb.index_size * sizeof(struct index_slot));
 
+  struct file_meta* metas =
+      (struct file_meta*)calloc(num > 0 ? num : 1, sizeof(struct file_meta));
+  char* file_data[256];
+  uint32_t data_offset = sb.data_offset;
+  for (uint32_t i = 0; i < num; i++) {
     struct stat st;
-    stat(file_path, &st);
-    int size = st.st_size;
-    file_size[i] = size;
-    //printf("%s, length = %ld, size = %d\n", file_path, strlen(file_path), size);
-
-    fwrite((const void*)file_name, sizeof(char), strlen(file_name), image_file);
-    for (int j = 0; j < 64 - strlen(file_name); j++) {
-      fwrite((const void*)&char_end, sizeof(char), 1, image_file);
+    if (stat(file_paths[i], &st) != 0) {
+      printf("stat %s failed!\n", file_paths[i]);
+      exit(1);
     }
-    fwrite((const void*)&size, sizeof(int), 1, image_file);
-
-    file_data_offsets[i] = data_offset;
-    fwrite((const void*)&file_data_offsets[i], sizeof(int), 1, image_file);
-
-    data_offset += size;
+    strcpy(metas[i].filename, file_names[i]);
+    metas[i].size = st.st_size;
+    metas[i].offset = data_offset;
+    file_data[i] = read_file(file_paths[i], metas[i].size);
+    metas[i].crc = crc32(file_data[i], metas[i].size);
+    data_offset = align_data(data_offset + metas[i].size);
   }
 
-  // Write file data.
-  for (int i = 0; i < num; i++) {
-    char* file_path = file_paths[i];
-    int size = file_size[i];
-    int offset = file_data_offsets[i];
-
-    FILE* prog_file;
-    if ((prog_file = fopen(file_path, "r")) == 0) {
-      printf("open %s failed!", file_path);
-      exit(1);
+  // Filename index, linear probing as naive fs looks up.
+  struct index_slot* index =
+      (struct index_slot*)calloc(sb.index_size, sizeof(struct index_slot));
+  for (uint32_t i = 0; i < num; i++) {
+    uint32_t hash = filename_hash(metas[i].filename);
+    uint32_t slot = hash & (sb.index_size - 1);
+    while (index[slot].meta != 0) {
+      slot = (slot + 1) & (sb.index_size - 1);
     }
-    char* buffer = (char*)malloc(size);
-    fread(buffer, 1, size, prog_file);
-    fwrite(buffer, 1, size, image_file);
-    free(buffer);
-    fclose(prog_file);
+    index[slot].hash = hash;
+    index[slot].meta = i + 1;
+  }
+
+  // Create disk image file.
+  uint32_t image_size = data_offset;
+  char* image = (char*)calloc(image_size, 1);
+  memcpy(image, &sb, sizeof(sb));
+  memcpy(image + sb.metas_offset, metas, num * sizeof(struct file_meta));
+  memcpy(image + sb.index_offset, index, sb.index_size * sizeof(struct index_slot));
+  for (uint32_t i = 0; i < num; i++) {
+    memcpy(image + metas[i].offset, file_data[i], metas[i].size);
   }
 
-  // Close.
+  FILE* image_file;
+  if ((image_file = fopen("./user_disk_image", "w+")) == 0) {
+    printf("create image file failed\n");
+    exit(1);
+  }
+  fwrite(image, 1, image_size, image_file);
   fclose(image_file);
+  free(image);
 
   // Print and verify.
   image_file = fopen("./user_disk_image", "r");
   if (image_file == 0) {
-    printf("open iamge file failed!");
+    printf("open image file failed!\n");
     exit(1);
   }
-  int file_num;
-  fread(&file_num, sizeof(int), 1, image_file);
-  printf("disk image has %d files\n", file_num);
-  for (int i = 0; i < file_num; i++) {
-    fseek(image_file, 4 + i * (64 + sizeof(int) + sizeof(int)), SEEK_SET);
-
-    char filename[64];
-    fread(filename, sizeof(char), 64, image_file);
-    int size;
-    fread(&size, sizeof(int), 1, image_file);
-    int data_offset;
-    fread(&data_offset, sizeof(int), 1, image_file);
-    printf(" - %s, data_offset = %d, size = %d\n", filename, data_offset, size);
+  struct superblock read_sb;
+  fread(&read_sb, sizeof(read_sb), 1, image_file);
+  if (read_sb.magic != NAIVE_FS_MAGIC || read_sb.version != NAIVE_FS_VERSION) {
+    printf("bad superblock\n");
+    exit(1);
+  }
+  printf("disk image has %u files\n", read_sb.file_num);
+  for (uint32_t i = 0; i < read_sb.file_num; i++) {
+    struct file_meta meta;
+    fseek(image_file, read_sb.metas_offset + i * sizeof(meta), SEEK_SET);
+    fread(&meta, sizeof(meta), 1, image_file);
+    printf(" - %s, data_offset = %u, size = %u, crc = %08x\n",
+           meta.filename, meta.offset, meta.size, meta.crc);
 
     // read data
-    char* buffer = (char*)malloc(size);
-    fseek(image_file, data_offset, SEEK_SET);
-    fread(buffer, 1, size, image_file);
-
-    // get origin file data.
-    char* file_path = file_paths[i];
-    FILE* origin_file;
-    if ((origin_file = fopen(file_path, "r")) == 0) {
-      printf("open origin file %s failed!", file_path);
-      exit(1);
-    }
-    char* origin_file_buffer = (char*)malloc(size);
-    fread(origin_file_buffer, 1, size, origin_file);
-
-    // compare
-    if (memcmp(buffer, origin_file_buffer, size) != 0) {
-      printf("file %s diff!\n", file_path);
+    char* buffer = (char*)malloc(meta.size > 0 ? meta.size : 1);
+    fseek(image_file, meta.offset, SEEK_SET);
+    fread(buffer, 1, meta.size, image_file);
+
+    // compare with origin file data
+    if ((PARTITION_OFFSET + meta.offset) % NAIVE_FS_DATA_ALIGN != 0 ||
+        meta.size != metas[i].size ||
+        memcmp(buffer, file_data[i], meta.size) != 0 || crc32(buffer, meta.size) != meta.crc) {
+      printf("file %s diff!\n", file_paths[i]);
       exit(1);
     }
-
     free(buffer);
-    free(origin_file_buffer);
-    fclose(origin_file);
+    free(file_data[i]);
   }
+  fclose(image_file);
+  return 0;
 }
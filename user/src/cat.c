@@ -1,7 +1,12 @@
 #include "common/common.h"
 #include "common/stdio.h"
+#include "common/stdlib.h"
 #include "syscall/syscall.h"
+#include "syscall/syscall_impl.h"
 #include "fs/file.h"
+#include "sys/ring.h"
+
+#define READ_CHUNK_SIZE  512
 
 int main(uint32 argc, char* argv[]) {
   if (argc != 2) {
@@ -10,21 +15,46 @@ int main(uint32 argc, char* argv[]) {
   }
 
   char* path = argv[1];
-
-  file_stat_t file_stat;
-  if (stat(path, &file_stat) != 0) {
+  int32 fd = open(path, O_RDONLY);
+  if (fd < 0) {
     printf("Could not find file \"%s\"\n", path);
     return -1;
   }
 
-  uint32 size = file_stat.size;
-  char read_buffer[size + 1];
-  if (read(path, read_buffer, 0, size) != size) {
-    printf("Failed to read file \"%s\"\n", path);
+  syscall_ring_t* ring = ring_init();
+  if (ring == nullptr) {
+    printf("Failed to setup syscall ring\n");
+    close(fd);
     return -1;
   }
-  read_buffer[size] = '\0';
 
-  printf("%s", read_buffer);
-  return 0;
+  // Read and print each chunk in one batch. Ring entries run in order, so print sees the
+  // data, and fd offset moves on to the next chunk.
+  char read_buffer[READ_CHUNK_SIZE + 1];
+  char* print_args[1] = {read_buffer};
+  int32 ret = 0;
+  while (true) {
+    memset(read_buffer, 0, READ_CHUNK_SIZE + 1);
+    ring_prep(ring, SYSCALL_READ_NUM, fd, (uint32)read_buffer, READ_CHUNK_SIZE, 0, 0);
+    ring_prep(ring, SYSCALL_PRINT_NUM, (uint32)"%s", (uint32)print_args, 0, 0, 1);
+    ring_submit(ring);
+
+    int32 read_size = 0;
+    ring_cqe_t cqe;
+    while (ring_complete(ring, &cqe)) {
+      if (cqe.user_data == 0) {
+        read_size = cqe.result;
+      }
+    }
+    if (read_size < 0) {
+      printf("\nFailed to read file \"%s\"\n", path);
+      ret = -1;
+    }
+    if (read_size < READ_CHUNK_SIZE) {
+      break;
+    }
+  }
+
+  close(fd);
+  return ret;
 }
@@ -0,0 +1,8 @@
+#include "common/common.h"
+#include "common/stdio.h"
+#include "syscall/syscall.h"
+
+int main(uint32 argc, char* argv[]) {
+  list_process();
+  return 0;
+}
@@ -7,6 +7,9 @@
 
 #define LINE_CURSOR_INDEX_MIN  3
 
+// Shell is latency-sensitive, run it ahead of default priority (10) batch programs.
+#define SHELL_PRIORITY  16
+
 char cmd_buffer[512];
 int32 cmd_end_index = 0;
 
@@ -187,5 +190,6 @@ static int32 run_shell() {
 }
 
 int32 main(uint32 argc, char* argv[]) {
+  set_priority(0, SHELL_PRIORITY);
   return run_shell();
 }
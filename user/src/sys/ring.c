@@ -0,0 +1,47 @@
+#include "syscall/syscall.h"
+#include "sys/ring.h"
+
+syscall_ring_t* ring_init() {
+  int32 addr = ring_setup();
+  if (addr < 0) {
+    return nullptr;
+  }
+  return (syscall_ring_t*)addr;
+}
+
+bool ring_prep(syscall_ring_t* ring, uint32 opcode, uint32 arg1, uint32 arg2, uint32 arg3,
+               uint32 arg4, uint32 user_data) {
+  uint32 sq_tail = ring->sq_tail;
+  if (sq_tail - ring->sq_head >= RING_SQ_ENTRIES) {
+    return false;
+  }
+  ring_sqe_t* sqe = &ring->sq[sq_tail % RING_SQ_ENTRIES];
+  sqe->opcode = opcode;
+  sqe->args[0] = arg1;
+  sqe->args[1] = arg2;
+  sqe->args[2] = arg3;
+  sqe->args[3] = arg4;
+  sqe->user_data = user_data;
+  // Entry must be filled before it's published.
+  asm volatile("" : : : "memory");
+  ring->sq_tail = sq_tail + 1;
+  return true;
+}
+
+int32 ring_submit(syscall_ring_t* ring) {
+  uint32 pending = ring->sq_tail - ring->sq_head;
+  if (pending == 0) {
+    return 0;
+  }
+  return ring_enter(pending);
+}
+
+bool ring_complete(syscall_ring_t* ring, ring_cqe_t* cqe) {
+  uint32 cq_head = ring->cq_head;
+  if (cq_head == ring->cq_tail) {
+    return false;
+  }
+  *cqe = ring->cq[cq_head % RING_CQ_ENTRIES];
+  ring->cq_head = cq_head + 1;
+  return true;
+}
@@ -0,0 +1,20 @@
+#ifndef SYS_RING_H
+#define SYS_RING_H
+
+#include "common/common.h"
+#include "syscall/ring.h"
+
+// Map syscall ring of this process.
+syscall_ring_t* ring_init();
+
+// Queue a syscall. Returns false if submission ring is full.
+bool ring_prep(syscall_ring_t* ring, uint32 opcode, uint32 arg1, uint32 arg2, uint32 arg3,
+               uint32 arg4, uint32 user_data);
+
+// Submit all queued entries by one syscall. Returns the number consumed.
+int32 ring_submit(syscall_ring_t* ring);
+
+// Pop next completion. Returns false if there is none.
+bool ring_complete(syscall_ring_t* ring, ring_cqe_t* cqe);
+
+#endif
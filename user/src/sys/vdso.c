@@ -0,0 +1,49 @@
+#include "sys/vdso.h"
+#include "mem/vdso.h"
+
+static volatile vdso_time_page_t* time_page = (vdso_time_page_t*)VDSO_TIME_VADDR;
+static volatile vdso_process_page_t* process_page = (vdso_process_page_t*)VDSO_PROCESS_VADDR;
+
+static uint64 rdtsc() {
+  uint32 low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64)high << 32) | low;
+}
+
+// Same conversion as kernel clock.
+static uint64 cycles_to_ns(uint64 cycles, uint32 mult, uint32 shift) {
+  uint32 high = (uint32)(cycles >> 32);
+  uint32 low = (uint32)cycles;
+  uint64 ns = ((uint64)low * mult) >> shift;
+  if (high > 0) {
+    ns += ((uint64)high * mult) << (32 - shift);
+  }
+  return ns;
+}
+
+uint32 vdso_get_tick() {
+  return time_page->tick;
+}
+
+uint64 vdso_clock_monotonic_ns() {
+  uint32 seq;
+  uint64 ns;
+  do {
+    seq = time_page->seq;
+    if (seq & 1) {
+      continue;
+    }
+    asm volatile("" : : : "memory");
+    if (time_page->tsc_enabled) {
+      ns = cycles_to_ns(rdtsc() - time_page->tsc_base, time_page->tsc_mult, time_page->tsc_shift);
+    } else {
+      ns = (uint64)time_page->tick * (1000000000 / time_page->timer_frequency);
+    }
+    asm volatile("" : : : "memory");
+  } while ((seq & 1) || time_page->seq != seq);
+  return ns;
+}
+
+uint32 vdso_getpid() {
+  return process_page->pid;
+}
@@ -0,0 +1,14 @@
+#ifndef SYS_VDSO_H
+#define SYS_VDSO_H
+
+#include "common/common.h"
+
+// Read kernel data from vDSO pages, without syscalls.
+uint32 vdso_get_tick();
+
+// Nanoseconds since boot, same as clock_gettime but without trapping into kernel.
+uint64 vdso_clock_monotonic_ns();
+
+uint32 vdso_getpid();
+
+#endif
@@ -0,0 +1,33 @@
+#include "common/common.h"
+#include "common/stdio.h"
+#include "syscall/syscall.h"
+#include "sys/vdso.h"
+
+#define ROUNDS  100000
+
+// Average ns of a null syscall: by int 0x80, by SYSENTER, and by reading vDSO page.
+int main(uint32 argc, char* argv[]) {
+  uint64 start = vdso_clock_monotonic_ns();
+  for (uint32 i = 0; i < ROUNDS; i++) {
+    getpid_int();
+  }
+  uint32 int_ns = (uint32)(vdso_clock_monotonic_ns() - start);
+
+  start = vdso_clock_monotonic_ns();
+  for (uint32 i = 0; i < ROUNDS; i++) {
+    getpid();
+  }
+  uint32 sysenter_ns = (uint32)(vdso_clock_monotonic_ns() - start);
+
+  start = vdso_clock_monotonic_ns();
+  for (uint32 i = 0; i < ROUNDS; i++) {
+    vdso_getpid();
+  }
+  uint32 vdso_ns = (uint32)(vdso_clock_monotonic_ns() - start);
+
+  printf("getpid x %u\n", ROUNDS);
+  printf("  int 0x80: %u ns/call\n", int_ns / ROUNDS);
+  printf("  sysenter: %u ns/call\n", sysenter_ns / ROUNDS);
+  printf("  vdso:     %u ns/call\n", vdso_ns / ROUNDS);
+  return 0;
+}
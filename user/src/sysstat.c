@@ -0,0 +1,61 @@
+#include "common/common.h"
+#include "common/stdio.h"
+#include "syscall/syscall.h"
+
+#define MAX_SYSCALLS  64
+
+static syscall_stat_t stats[MAX_SYSCALLS];
+
+// Upper bound (2^(i+1) cycles) of the bucket where percent% of calls fall below.
+static uint32 percentile_bucket(syscall_stat_t* stat, uint32 total, uint32 percent) {
+  uint32 target = (total * percent + 99) / 100;
+  uint32 count = 0;
+  for (uint32 i = 0; i < SYSCALL_LATENCY_BUCKETS; i++) {
+    count += stat->latency_hist[i];
+    if (count >= target) {
+      return i + 1;
+    }
+  }
+  return SYSCALL_LATENCY_BUCKETS;
+}
+
+// Print syscalls by number of calls, with p50 and p99 latency in log2 cycles.
+int main(uint32 argc, char* argv[]) {
+  int32 num = syscall_stats(stats, MAX_SYSCALLS);
+  if (num < 0) {
+    printf("syscall_stats failed\n");
+    return -1;
+  }
+
+  // selection sort by calls, descending
+  for (int32 i = 0; i < num; i++) {
+    int32 max_index = i;
+    for (int32 j = i + 1; j < num; j++) {
+      if (stats[j].calls > stats[max_index].calls) {
+        max_index = j;
+      }
+    }
+    syscall_stat_t tmp = stats[i];
+    stats[i] = stats[max_index];
+    stats[max_index] = tmp;
+  }
+
+  printf("syscall: calls, p50 and p99 latency\n");
+  for (int32 i = 0; i < num; i++) {
+    syscall_stat_t* stat = &stats[i];
+    if (stat->calls == 0) {
+      continue;
+    }
+    uint32 measured = 0;
+    for (uint32 j = 0; j < SYSCALL_LATENCY_BUCKETS; j++) {
+      measured += stat->latency_hist[j];
+    }
+    printf("%s: %u", stat->name, stat->calls);
+    if (measured > 0) {
+      printf(", < 2^%u, < 2^%u cycles", percentile_bucket(stat, measured, 50),
+             percentile_bucket(stat, measured, 99));
+    }
+    printf("\n");
+  }
+  return 0;
+}